@@ -151,6 +151,20 @@ typedef LAKE_ATOMIC(usize)      atomic_usize;
 #define lake_atomic_or(RMW, ARG) \
     lake_atomic_or_explicit(RMW, ARG, lake_memory_model_relaxed)
 
+/** A hint for the CPU that the thread is in a spin-wait loop. */
+LAKE_FORCE_INLINE void lake_cpu_relax(void)
+{
+#if defined(LAKE_ARCH_X86) || defined(LAKE_ARCH_AMD64)
+    #if defined(LAKE_CC_MSVC_VERSION)
+        _mm_pause();
+    #else
+        __builtin_ia32_pause();
+    #endif
+#elif (defined(LAKE_ARCH_ARM) || defined(LAKE_ARCH_AARCH64)) && !defined(LAKE_CC_MSVC_VERSION)
+    __asm__ __volatile__("yield");
+#endif
+}
+
 /** The spinlock is not recursive. */
 typedef struct {
     lake_atomic_flag flag;
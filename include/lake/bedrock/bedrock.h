@@ -56,11 +56,17 @@ typedef struct lake_bedrock_hints {
     /** Sets a hard limit on the physical resources the framework is allowed to use. If 0, default 
      *  will be the system's total RAM memory. This budget is used to reserve virtual address space. */
     usize   memory_budget;
+    /** Blocks of the tagged heap left free by `lake_thfree()` stay committed up to this many bytes, 
+     *  so they can be taken again without faulting pages in. Free blocks above this size are returned 
+     *  to the host in the background, once they stayed unused for a while. If 0, default will be 
+     *  an eighth of the memory budget. A value not lower than the budget keeps every block committed. */
+    usize   tagged_heap_high_water_mark;
     /** Target size for hugetlb entries. If 0, default will be the default huge page size (usually 2MB).
      *  If set at a non-zero value, this will serve as the limit - the lowest valid page size will be picked.
      *  Whenever the huge page size could not be resolved, normal page size is set (usually 4096KB). */
     u32     page_size_in_use;
-    /** Number of empty tagged heaps to prepare. This value only references to user defined tags. */
+    /** Number of empty tagged heaps to prepare. This value only references to user defined tags. 
+     *  Heaps are found by their tag through a hash table, so many short lifetimes don't slow it down. */
     u32     tagged_heap_count;
     /** Number of threads to create. If 0, default will be the system's CPU count. 
      *  Worker threads have CPU affinity, thus we don't allow to create more threads than CPUs available. */
@@ -69,8 +75,26 @@ typedef struct lake_bedrock_hints {
     u32     fiber_stack_size;
     /** Number of fibers to create. If 0, default will be 96 + 4 * worker_thread_count. */
     u32     fiber_count;
-    /** The job queue will be of this size: (1u << log2_job_count). If 0, default will be 10 (1024). */
+    /** Stack size of fibers for `lake_fiber_stack_small` work. If 0, default will be 16KB. */
+    u32     fiber_stack_size_small;
+    /** Number of fibers with a small stack. If 0, default will be the fiber count. */
+    u32     fiber_count_small;
+    /** Stack size of fibers for `lake_fiber_stack_large` work. If 0, default will be 256KB. */
+    u32     fiber_stack_size_large;
+    /** Number of fibers with a large stack. If 0, default will be 8 + worker_thread_count. */
+    u32     fiber_count_large;
+    /** Number of work chains in the pool. If 0, default will be the fiber count. */
+    u32     work_chain_count;
+    /** Number of timers for sleeping fibers and delayed work. If 0, default will be twice the fiber count. */
+    u32     timer_count;
+    /** The job queue will be of this size: (1u << log2_job_count). If 0, default will be 11 (2048). */
     u32     log2_work_count;
+    /** Every worker thread owns a work-stealing deque of this size: (1u << log2_deque_work_count). 
+     *  If 0, default will be 8 (256). Work that doesn't fit will spill into the shared job queue. */
+    u32     log2_deque_work_count;
+    /** Up to (1u << log2_io_request_count) asynchronous file reads and writes can be in flight, 
+     *  more will run synchronously. If 0, default will be 8 (256). */
+    u32     log2_io_request_count;
     /** How many frames can the CPU get ahead of the GPU. Usually 2-4. */
     u32     frames_in_flight;
     /** Explicit debug tools will be enabled, may be limited on release/NDEBUG builds.
@@ -227,10 +251,14 @@ typedef void (LAKECALL *PFN_lake_bedrock_main)(void *userdata, lake_bedrock cons
  *  will be provided. After init is done, a fiber calls into the `main` procedure, passing 
  *  in the self-defined userdata and immutable framework configuration.
  *
- *  A fiber-aware job queue with a capacity of (1 << log2_work_count is created. The queue 
- *  has NO concept of priority, so there is no job stealing either. `worker_thread_count` 
- *  system threads are created, each one locked to a CPU core. Every fiber of `fiber_count`
- *  has it's own stack region of `fiber_stack_size`. Virtual memory is mapped for internal 
+ *  A fiber-aware job queue with a capacity of (1 << log2_work_count) is created, it is used 
+ *  for work submitted from threads outside of the framework. Every worker thread owns a 
+ *  work-stealing deque of (1 << log2_deque_work_count) capacity, work submitted from a fiber 
+ *  goes there and idle workers will steal from each other, preferring workers that share 
+ *  the last level cache. `worker_thread_count` system threads are created, each one locked 
+ *  to a CPU: one per physical core first, SMT siblings only after that. Every fiber of 
+ *  `fiber_count` has it's own guarded stack region of `fiber_stack_size`, with additional 
+ *  pools of fibers for the small and large stack classes. Virtual memory is mapped for internal 
  *  use with a hard limit of `memory_budget`. The memory budget is aligned to a hugetlb 
  *  page entry, and if no limit is provided the virtual map is set to the amount of RAM in 
  *  the host system. The `huge_page_size` works as a ceiling, and the largest possible value
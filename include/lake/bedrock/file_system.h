@@ -57,6 +57,22 @@ void LAKECALL lake_fs_observer_remove_ref(lake_fs_observer *observer, s32 contex
 LAKEAPI LAKE_NONNULL_ALL
 FN_LAKE_WORK(lake_fs_observer_destructor, lake_fs_observer *observer);
 
+/** Reads up to `size` bytes at `offset` of an open file descriptor into `dst`. The calling fiber 
+ *  yields until the read completes, so the worker thread runs other work in the meantime instead 
+ *  of blocking in the kernel. Completions are reaped by workers that look for work. Asynchronous 
+ *  I/O is backed by io_uring on Linux. On other hosts, on kernels without io_uring, or when too 
+ *  many requests are in flight, the read runs synchronously on the calling worker instead, with 
+ *  the same results. 
+ *  @return Count of bytes read, it may be short at the end of file, or a negative errno. */
+LAKEAPI LAKE_NONNULL(2)
+s64 LAKECALL lake_fs_read_async(s32 fd, void *dst, usize size, u64 offset);
+
+/** Writes up to `size` bytes from `src` at `offset` of an open file descriptor, the calling fiber 
+ *  yields until it completes, see `lake_fs_read_async()`. 
+ *  @return Count of bytes written, or a negative errno. */
+LAKEAPI LAKE_NONNULL(2)
+s64 LAKECALL lake_fs_write_async(s32 fd, void const *src, usize size, u64 offset);
+
 /** A string of the executable path allocated using drifter. */
 LAKEAPI LAKE_NONNULL_ALL
 char *LAKECALL lake_fs_executable_path(void);
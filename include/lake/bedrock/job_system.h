@@ -18,6 +18,16 @@
  *  of execution is switched with a fiber that contains details of a new job to run. 
  *  Only when all work of a single submission is done, a yielding fiber may resume.
  *
+ *  Every worker thread owns a work-stealing deque. Work submitted from a fiber is pushed into 
+ *  the deque of the worker it runs on, and is popped back in LIFO order to keep caches warm. 
+ *  Workers that run out of work will steal from the other end of a random victim's deque. 
+ *  The shared MPMC ring buffer is only an injection queue, for work submitted from threads 
+ *  outside of the framework and for work that didn't fit into a full deque.
+ *
+ *  Work is submitted with a priority class. Workers always look for high priority work first, 
+ *  then normal work. Background work has no deques, it waits in it's own injection queue 
+ *  until a worker finds nothing else to do, so it won't delay latency-critical work.
+ *
  *  Context switching is very CPU specific. This functionality is implemented in assembly
  *  for every architecture and platform ABI that should be supported. A great deal of help 
  *  in implementing this is the source code of Boost C++ fiber context library. It has most 
@@ -30,8 +40,9 @@
  *      [Fibers, Oh My!]
  *      https://graphitemaster.github.io/fibers/
  *
- *  Because the fiber stacks are created as a large flat array, there is NO protection from 
- *  a stack overflow. It will just walk into the neighbouring fiber's stack and corrupt it.
+ *  Fiber stacks come in a few size classes, picked per job. Every stack is preceded by 
+ *  a guard page, so a stack overflow faults instead of corrupting the neighbouring fiber. 
+ *  Stack pages are committed on first use, a job that needs little stack costs little memory.
  *
  *  Fundamental to the fiber code is thread local storage (TLS). It's used as a way for the 
  *  system to communicate between jobs. Instead of using an OS or compiler provided TLS,
@@ -51,15 +62,24 @@
  *
  *  Some notes:
  *
- *  - A deadlock happens if the MPMC ring buffer is full and running from only one thread. 
- *    This will also happen when dequeuing from an empty buffer, when running a single thread.
- *    The reason being, that the waiting for enqueue/dequeue thread may never leave the loop,
- *    when there is no other thread to try to empty/fill it. This should not really be an issue 
- *    unless stress testing the job system on single core environments.
+ *  - Submitting work never blocks. When the MPMC ring buffer is full, the rest of the work 
+ *    goes into an unbounded overflow list of heap allocated segments, that workers check only 
+ *    while it's not empty. Size `log2_work_count` for the usual load, overflow is the slow path.
+ *
+ *  - Waiting fibers are not polled. The thread that drops a chain to zero pushes the fiber 
+ *    waiting on it into a ready queue, that is checked before looking for new work.
+ *
+ *  - Work can be continued after a chain, the thread that drops the chain submits it. 
+ *    Pipelines and fan-in of work don't need a fiber parked on every stage.
+ *
+ *  - Work and yielding fibers can be pinned to a worker thread, for APIs bound to one thread. 
+ *    Every worker has it's own pinned queue, that only it drains, before any shared queue.
+ *
+ *  - Sleeping fibers and delayed work are kept in a hierarchical timer wheel, it's turned 
+ *    by workers looking for work. Parked workers won't sleep past the next deadline.
  *
- *  - The free and wait list implementations are pretty naive. There should be a better lockless 
- *    way of accessing them as opposed to looping over them. I suspect there is a lot of cache 
- *    churn and false sharing around index 0 between lots of threads.
+ *  - Free fibers are kept in a lock-free stack with a generation tagged head, taking 
+ *    or returning a fiber is a single compare-and-swap regardless of the fiber count.
  *
  *  - May get into improving context switching branch prediction, if this can improve speed: 
  *    http://www.crystalclearsoftware.com/soc/coroutine/coroutine/linuxasm.html
@@ -79,18 +99,47 @@ typedef void (LAKECALL *PFN_lake_work)(void *userdata);
 /** Declares a job, can be cast into `PFN_lake_work`. */
 #define FN_LAKE_WORK(fn, arg) void LAKECALL fn(arg)
 
+/** Stack size classes of fibers. Every class has it's own pool of fibers, their sizes and 
+ *  counts are configured by the framework hints. If a class runs out of free fibers, a fiber 
+ *  with a larger stack is used instead. */
+typedef enum lake_fiber_stack : s8 {
+    /** The default, with stacks of `fiber_stack_size`. */
+    lake_fiber_stack_normal = 0,
+    /** For leaf jobs that don't go deep into the call stack. */
+    lake_fiber_stack_small,
+    /** For the few jobs that need it, e.g. those calling into drivers. */
+    lake_fiber_stack_large,
+    lake_fiber_stack_count,
+} lake_fiber_stack;
+
 /** Details of the job description. */
 typedef struct lake_work_details {
-    PFN_lake_work   procedure;  /**< Job to run. */
-    void           *argument;   /**< Data for the job. */
-    const char     *name;       /**< A fiber will adopt this name for profiling. */
+    PFN_lake_work       procedure;  /**< Job to run. */
+    void               *argument;   /**< Data for the job. */
+    const char         *name;       /**< A fiber will adopt this name for profiling. */
+    lake_fiber_stack    stack;      /**< Stack size class of the fiber to run on. */
 } lake_work_details;
 
-/** An atomic counter bound to a work submit. If used within a call to the job system,
+/** Priority classes of submitted work, a higher class is always drained first. */
+typedef enum lake_work_priority : s8 {
+    /** Latency-critical work, e.g. the GPU execution stage or audio mixing. */
+    lake_work_priority_high = 0,
+    /** The default for `lake_submit_work()`. */
+    lake_work_priority_normal,
+    /** Bulk work that runs only on idle workers, e.g. asset decoding. */
+    lake_work_priority_background,
+    lake_work_priority_count,
+} lake_work_priority;
+
+/** A handle to an atomic counter bound to a work submit. If used within a call to the job system,
  *  this chain is used to "wait" for the work to finish. A fiber that yields while waiting 
  *  for the submit to return, instead of blocking or busy-waiting, will implicitly perform 
- *  a context switch. This synchronization work is completely hidden from the user. */
-typedef atomic_usize *lake_work_chain;
+ *  a context switch. This synchronization work is completely hidden from the user.
+ *
+ *  Chains are taken from a pool, the handle packs a generation with an index into it. 
+ *  Using a chain that has expired is detected, instead of aliasing a reused chain. 
+ *  A value of zero is a null chain. */
+typedef u64 lake_work_chain;
 
 /** Acquire an external chain not bound to any valid work. When this chain is given to 
  *  `lake_yield()`, the fiber will wait until this chain is released by another thread. */
@@ -98,9 +147,10 @@ LAKEAPI LAKE_HOT_FN
 lake_work_chain LAKECALL lake_acquire_chain_v(usize initial_value);
 #define lake_acquire_chain() lake_acquire_chain_v(1)
 
-/** Release a chain acquired externally to a work submission. */
-LAKE_FORCE_INLINE void lake_release_chain(lake_work_chain chain)
-{ lake_atomic_write_explicit(chain, 0lu, lake_memory_model_release); }
+/** Release a chain acquired externally to a work submission. A fiber waiting on 
+ *  this chain is woken up and pushed into the ready queue of the job system. */
+LAKEAPI LAKE_HOT_FN
+void LAKECALL lake_release_chain(lake_work_chain chain);
 
 /** Returns an index of the worker thread the current fiber is running on. This index 
  *  can be used to access an array of per-thread data structures. The index is acquired 
@@ -113,6 +163,42 @@ u32 LAKECALL lake_worker_thread_index(void);
 LAKEAPI LAKE_HOT_FN LAKE_PURE_FN
 char const *LAKECALL lake_fiber_name(void);
 
+/** Scheduler counters of a worker thread, they only grow from the framework initialization. 
+ *  Overlays and exporters take snapshots at their own rate, and diff them to get rates. */
+typedef struct lake_worker_stats {
+    u64 jobs_run;           /**< Work that has started, on a new fiber or on a reused one. */
+    u64 fiber_switches;     /**< Context switches into a fiber, to start new work or to resume. */
+    u64 local_pops;         /**< Work popped from the worker's own deques. */
+    u64 queue_dequeues;     /**< Work taken from the shared queues, their overflow or the pinned queue. */
+    u64 steals;             /**< Work stolen from the deques of other workers. */
+    u64 idle_ns;            /**< Time spent looking for work, spinning and parked. */
+    u64 parks;              /**< How many times the worker parked, as spinning didn't pay off. */
+    u64 wait_polls;         /**< Polls of a chain, that a fiber not yet switched out is about to wait on. */
+    u64 deque_depth_max;    /**< High-water mark of work in a deque of the worker. */
+} lake_worker_stats;
+
+/** Copies the scheduler counters of up to `capacity` worker threads into `out_stats`, indexed 
+ *  the same as `lake_worker_thread_index()`. Returns the count of worker threads. Counters are 
+ *  read one by one while the workers are running, so a snapshot is not consistent as a whole. */
+LAKEAPI
+u32 LAKECALL lake_worker_stats_snapshot(
+    u32                      capacity,
+    lake_worker_stats       *out_stats);
+
+/** Number of fiber-local storage slots available to every job. */
+#define LAKE_FLS_SLOT_COUNT 8
+
+/** Fiber-local storage (FLS) is a small array of pointers owned by the currently running job. 
+ *  It follows the job across yields, even if it resumes on another worker thread, and every 
+ *  slot is reset to null before the fiber starts new work. Subsystems agree on the slot index 
+ *  they use, from 0 to (LAKE_FLS_SLOT_COUNT - 1). */
+LAKEAPI LAKE_HOT_FN
+void *LAKECALL lake_fls_get(u32 slot);
+
+/** Writes into a fiber-local storage slot of the currently running job. */
+LAKEAPI LAKE_HOT_FN
+void LAKECALL lake_fls_set(u32 slot, void *value);
+
 /** Submits `work_count` of work to the job queue, using details provided by the array of `work`.
  *  This function will return IMMEDIATELY, and the given work will be resolved in the background 
  *  running on different worker threads. If `out_chain` is not nullptr, it will be set to a value 
@@ -123,6 +209,40 @@ void LAKECALL lake_submit_work(
     lake_work_details const *work, 
     lake_work_chain         *out_chain);
 
+/** Submits work the same way as `lake_submit_work()`, but with the given priority class. */
+LAKEAPI LAKE_THREAD_SAFETY_ACQUIRE_SHARED(4) LAKE_NONNULL(3) LAKE_HOT_FN 
+void LAKECALL lake_submit_work_priority(
+    lake_work_priority       priority,
+    u32                      work_count, 
+    lake_work_details const *work, 
+    lake_work_chain         *out_chain);
+
+/** Submits work the same way as `lake_submit_work()`, but the work will run only on the worker 
+ *  thread of the given index, see `lake_worker_thread_index()`. It's for APIs that must be called 
+ *  from one specific thread. Pinned work is taken before any other work, regardless of priority. 
+ *  Only the work is pinned, a job that yields with `lake_yield()` may resume on another worker, 
+ *  use `lake_yield_pinned()` to stay. */
+LAKEAPI LAKE_THREAD_SAFETY_ACQUIRE_SHARED(4) LAKE_NONNULL(3) LAKE_HOT_FN 
+void LAKECALL lake_submit_work_on(
+    u32                      worker_idx,
+    u32                      work_count, 
+    lake_work_details const *work, 
+    lake_work_chain         *out_chain);
+
+/** Submits work the same way as `lake_submit_work_priority()`, but only after the work of the 
+ *  `after` chain has completed. The thread that drops the chain to zero submits the work with 
+ *  the given priority class, so no fiber has to wait for it. The chain is consumed, like a chain given to `lake_yield()`, and only 
+ *  one fiber or continuation may wait on a chain. If `out_chain` is not nullptr, it's set to 
+ *  a chain of the continued work right away, so continuations can be chained into pipelines. 
+ *  The details are copied, the `work` array doesn't have to outlive this call. */
+LAKEAPI LAKE_THREAD_SAFETY_ACQUIRE_SHARED(5) LAKE_NONNULL(4) LAKE_HOT_FN 
+void LAKECALL lake_submit_work_after(
+    lake_work_priority       priority,
+    lake_work_chain          after,
+    u32                      work_count, 
+    lake_work_details const *work, 
+    lake_work_chain         *out_chain);
+
 /** If chain is not NULL, the fiber will yield and won't resume until the completion of work 
  *  that is chained. Otherwise if no chain is given, then the fiber may or may not yield to 
  *  the job system before returning. The chain becomes invalidated and any more yields will 
@@ -130,17 +250,89 @@ void LAKECALL lake_submit_work(
 LAKEAPI LAKE_THREAD_SAFETY_RELEASE_SHARED(1) LAKE_HOT_FN 
 void LAKECALL lake_yield(lake_work_chain chain);
 
+/** Yields the same way as `lake_yield()`, but the fiber will resume on the same worker thread 
+ *  it yielded from. Must be called from a fiber of a worker thread. */
+LAKEAPI LAKE_THREAD_SAFETY_RELEASE_SHARED(1) LAKE_HOT_FN 
+void LAKECALL lake_yield_pinned(lake_work_chain chain);
+
+/** Submits work the same way as `lake_submit_work_priority()`, but it won't run before the 
+ *  deadline, given in nanoseconds of `lake_time_ns()`. Until then the work waits in a timer 
+ *  wheel, it doesn't occupy a worker or a fiber. The chain counts the delayed work right away, 
+ *  so yielding on it will wait for the deadline too. Timers are fired by workers that look 
+ *  for work, if all of them are busy the work may run late, but never early. */
+LAKEAPI LAKE_THREAD_SAFETY_ACQUIRE_SHARED(5) LAKE_NONNULL(4) LAKE_HOT_FN 
+void LAKECALL lake_submit_work_delayed(
+    lake_work_priority       priority,
+    u64                      deadline_ns,
+    u32                      work_count, 
+    lake_work_details const *work, 
+    lake_work_chain         *out_chain);
+
+/** The fiber will yield and won't resume until the deadline, given in nanoseconds of 
+ *  `lake_time_ns()`. The worker is free to run other work in the meantime. Returns right 
+ *  away if the deadline has already passed. */
+LAKEAPI LAKE_HOT_FN 
+void LAKECALL lake_yield_until(u64 deadline_ns);
+
 /** Combines the effects of `lake_submit()` and `lake_yield()` into a single call.
  *  This function does not return until the completion of all submitted work. */
 LAKE_FORCE_INLINE void lake_submit_work_and_yield(
     u32                      work_count, 
     lake_work_details const *work)
 {
-    lake_work_chain chain = nullptr;
+    lake_work_chain chain = 0;
     lake_submit_work(work_count, work, &chain);
     lake_yield(chain);
 }
 
+/** Defines a procedure that runs a range [begin, end) of a parallel loop. */
+typedef void (LAKECALL *PFN_lake_parallel_for)(usize begin, usize end, void *userdata);
+/** Declares a procedure compatible with `PFN_lake_parallel_for`. */
+#define FN_LAKE_PARALLEL_FOR(fn, arg) void LAKECALL fn(usize begin, usize end, arg)
+
+/** Defines a procedure that reduces a range [begin, end) into a partial result. */
+typedef void (LAKECALL *PFN_lake_parallel_reduce)(usize begin, usize end, void *partial, void *userdata);
+/** Declares a procedure compatible with `PFN_lake_parallel_reduce`, T is the type of the result. */
+#define FN_LAKE_PARALLEL_REDUCE(fn, T, arg) void LAKECALL fn(usize begin, usize end, T *partial, arg)
+
+/** Defines a procedure that joins the partial result `right` into `left`. The right range 
+ *  always follows the left range, so the join doesn't have to be commutative. */
+typedef void (LAKECALL *PFN_lake_parallel_join)(void *left, void const *right, void *userdata);
+/** Declares a procedure compatible with `PFN_lake_parallel_join`, T is the type of the result. */
+#define FN_LAKE_PARALLEL_JOIN(fn, T, arg) void LAKECALL fn(T *left, T const *right, arg)
+
+/** Runs `fn` over the range [begin, end) in parallel, and returns when all of it is done. 
+ *  The range is split in halves recursively, until the chunks are not larger than `grain`. 
+ *  Every split submits the upper half as work, while the last chunk runs inline on the 
+ *  calling fiber. If grain is 0, it will be picked from the count of worker threads. 
+ *  This must be called from within the job system, as the calling fiber may yield. */
+LAKEAPI LAKE_NONNULL(4) LAKE_HOT_FN
+void LAKECALL lake_parallel_for(
+    usize                    begin,
+    usize                    end,
+    usize                    grain,
+    PFN_lake_parallel_for    fn,
+    void                    *userdata);
+
+/** The partial results of a parallel reduction are kept inline with the splits, up to this size. 
+ *  A larger value is reduced on the calling fiber, in one call over the whole range. */
+#define LAKE_PARALLEL_REDUCE_MAX_VALUE_SIZE 64
+
+/** Reduces the range [begin, end) in parallel, the range is split the same way as with 
+ *  `lake_parallel_for()`. Every chunk is reduced into a partial result of `value_size` bytes 
+ *  that starts as a copy of `identity`, and the partials are joined in order into `result`. */
+LAKEAPI LAKE_NONNULL(4, 5, 7, 8) LAKE_HOT_FN
+void LAKECALL lake_parallel_reduce(
+    usize                    begin,
+    usize                    end,
+    usize                    grain,
+    PFN_lake_parallel_reduce fn,
+    PFN_lake_parallel_join   join,
+    usize                    value_size,
+    void const              *identity,
+    void                    *result,
+    void                    *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -3,8 +3,16 @@
 /** @file lake/bedrock/machina.h 
  *  @brief Allocator for cache-friendly and fiber-aware general purpose allocations.
  *
- *  TODO docs
- *  Slab-based? Preferably lockless.
+ *  Small allocations (up to 2 KiB, aligned up to 256 bytes) made by worker threads are served 
+ *  from slabs of size classes, carved from tagged heap blocks. Every worker caches free objects 
+ *  in magazines of it's own, so the hot path takes no locks and no atomics. An object freed 
+ *  by a thread that doesn't own it's slab is pushed into a lock-free remote list of the slab, 
+ *  the owner collects these when it's magazine runs dry. Larger allocations, and those made 
+ *  outside of the framework or by threads that are not workers, go to the OS allocator. 
+ *
+ *  Slab memory lives until the framework returns, any allocation made by a worker within 
+ *  the framework must be freed before `lake_in_the_lungs()` returns. Releasing it later is 
+ *  a fatal error, the memory is no longer there and it can't be given to the OS allocator.
  */
 #include <lake/bedrock/types.h>
 
@@ -29,9 +37,7 @@ extern "C" {
 #define lake_zerop(mem) lake_memset((mem), 0, sizeof(*(mem)))
 #define lake_zeroa(mem) lake_memset((mem), 0, sizeof((mem)))
 
-/** Aligned OS allocator, used temporarily until i implement other strategies 
- *  for memory allocation, and how to integrate them with my fiber scheduler.
- *  They will later be replaced, and code will be refactored. TODO */
+/** Aligned general purpose allocator, the memory may come from slabs or from the OS. */
 LAKEAPI LAKE_HOT_FN 
 void *LAKECALL __lake_malloc(usize size, usize align);
 
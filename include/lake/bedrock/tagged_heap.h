@@ -12,6 +12,14 @@
  *  any unique value desribes an unique lifetime frequency. All blocks allocated under 
  *  a tag must be freed together, as there is no free(ptr) interface.
  *  Calling `lake_thfree(tag)` is enough to release resources.
+ *
+ *  Worker threads keep a few blocks of their own for the tags they allocate from, so 
+ *  small allocations don't contend on the heap. Only when these run out, a worker 
+ *  takes the lock of the heap and acquires more blocks from the shared bitmap.
+ *
+ *  Blocks of a freed tag stay committed, to be taken again by the next lifetime. If more 
+ *  of them stay unused than the `tagged_heap_high_water_mark` hint allows, a background job 
+ *  returns the pages of the blocks unused the longest to the host, after about a second.
  */
 #include <lake/bedrock/types.h>
 
@@ -80,6 +88,12 @@ typedef enum lake_thadvise_mode : u8 {
  *  The request size will be block aligned (256 KiB). */
 LAKEAPI usize LAKECALL lake_thadvise(usize request, lake_thadvise_mode mode);
 
+/** Runs a trim pass right away, the same as the background work armed by a freed tag, but with 
+ *  a high water mark of the caller. Pages of a free block are returned to the host only if the 
+ *  last pass saw the block free too, so it takes two passes to trim blocks freed just now. 
+ *  Returns how many bytes were trimmed. */
+LAKEAPI usize LAKECALL lake_thtrim(usize high_water_mark);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
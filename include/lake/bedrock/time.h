@@ -39,6 +39,11 @@ LAKE_HOT_FN
 LAKEAPI u64 LAKECALL 
 lake_rtc_frequency(void);
 
+/** Returns the real-time clock in nanoseconds, deadlines of the job system use this clock. */
+LAKE_HOT_FN 
+LAKEAPI u64 LAKECALL 
+lake_time_ns(void);
+
 /** Invoke this function exactly once per frame to record the current frame time.
  *  Only when the other functions defined in this header will be available. */
 LAKEAPI void LAKECALL 
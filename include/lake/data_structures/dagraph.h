@@ -3,7 +3,11 @@
 /** @file lake/data_structures/dagraph.h 
  *  @brief Directed acyclic graph optimized for parallelism.
  *
- *  TODO docs
+ *  The id of a node is it's index in the nodes array of the graph. A graph is executed 
+ *  on the job system, nodes without dependencies are submitted first. Every node that 
+ *  finishes decrements the reference count of it's dependents, and a dependent is launched 
+ *  when the count drops to zero. Execution doesn't change the structure of the graph, 
+ *  so a graph built once can be run again every frame.
  */
 #include <lake/bedrock/bedrock.h>
 #include <lake/data_structures/darray.h>
@@ -26,6 +30,8 @@ typedef enum lake_dagraph_edge_bits : lake_dagraph_edge {
 } lake_dagraph_edge_bits;
 
 /** A node represents a state, a change, a pass, some movement. */
+struct lake_dagraph;
+
 typedef struct LAKE_ALIGNMENT(64) lake_dagraph_node {
     /** Other nodes can use it to refer this node. */
     lake_dagraph_id             id;
@@ -45,14 +51,26 @@ typedef struct LAKE_ALIGNMENT(64) lake_dagraph_node {
     void                       *payload;
     /** Counts for the arrays above. */
     u32                         dependencies_count, dependents_count;
+    /** The graph that executes this node, set by `lake_dagraph_run()`. */
+    struct lake_dagraph        *graph;
 } lake_dagraph_node;
 
 /** Directed acyclic graph container, sub-graphs can be constructed from existing graphs. */
 typedef struct lake_dagraph {
     lake_darray                 nodes;              /**< darray<lake_dagraph_node> */
     lake_darray                 execution_order;    /**< darray<lake_dagraph_id> */
+    /** Count of nodes left to run in the current execution. */
+    lake_refcnt                 pending;
+    /** Released when the last node of the current execution is done. */
+    lake_work_chain             done;
 } lake_dagraph;
 
+/** Runs every node of the graph on the job system, respecting their dependencies, and 
+ *  returns when all of them are done. Must be called from within the job system. A graph 
+ *  can't be run again before the previous run returns, but it can be reused afterwards. */
+LAKEAPI LAKE_NONNULL_ALL LAKE_HOT_FN
+void LAKECALL lake_dagraph_run(lake_dagraph *graph);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -70,6 +70,19 @@ bool LAKECALL lake_mpmc_rotate(
     s32 const           pos_delta,
     lake_mpmc_result   *out_result);
 
+/** Either enqueue into or dequeue from the ring buffer, claiming up to `max_count` contiguous 
+ *  slots at once. All slots are validated first and then reserved with a single position update, 
+ *  so a batch costs one contended atomic no matter its size. Returns the number of claimed slots,
+ *  the first of them is at `out_result->node`, following slots wrap around the buffer mask. */
+LAKEAPI LAKE_NONNULL_ALL LAKE_HOT_FN
+s32 LAKECALL lake_mpmc_rotate_n(
+    lake_mpmc          *mpmc,
+    atomic_ssize       *in_or_out,
+    s32 const           stride,
+    s32 const           pos_delta,
+    s32 const           max_count,
+    lake_mpmc_result   *out_result);
+
 /** The producer. The data within cells is persistent, so submissions can be made from the stack. */
 #define lake_mpmc_enqueue_t(mpmc, T, submit) \
     ({ \
@@ -94,6 +107,34 @@ bool LAKECALL lake_mpmc_rotate(
         __success; \
     })
 
+/** The bulk producer. Enqueues up to `count` entries from the `submit` array, returns how many 
+ *  were actually written. A partial result means the ring buffer is full. */
+#define lake_mpmc_enqueue_bulk_t(mpmc, T, submit, count) \
+    ({ \
+        lake_mpmc_result __result; \
+        s32 __n = lake_mpmc_rotate_n(mpmc, &(mpmc)->enqueue_pos, lake_ssizeof(T), 0, count, &__result); \
+        for (s32 __i = 0; __i < __n; __i++) { \
+            T *__node = (T *)lake_elem((mpmc)->buffer, lake_ssizeof(T), (__result.pos + __i) & (mpmc)->buffer_mask); \
+            lake_memcpy(&__node->data, &(submit)[__i], sizeof(lake_typeof(*(submit)))); \
+            lake_atomic_write_explicit(&__node->sequence, __result.pos + __i + 1, lake_memory_model_release); \
+        } \
+        __n; \
+    })
+
+/** The bulk consumer. Dequeues up to `count` entries into the `submit` array, returns how many 
+ *  were actually read. A partial result means the ring buffer was drained. */
+#define lake_mpmc_dequeue_bulk_t(mpmc, T, submit, count) \
+    ({ \
+        lake_mpmc_result __result; \
+        s32 __n = lake_mpmc_rotate_n(mpmc, &(mpmc)->dequeue_pos, lake_ssizeof(T), 1, count, &__result); \
+        for (s32 __i = 0; __i < __n; __i++) { \
+            T *__node = (T *)lake_elem((mpmc)->buffer, lake_ssizeof(T), (__result.pos + __i) & (mpmc)->buffer_mask); \
+            lake_memcpy(&(submit)[__i], &__node->data, sizeof(lake_typeof(*(submit)))); \
+            lake_atomic_write_explicit(&__node->sequence, __result.pos + __i + (mpmc)->buffer_mask + 1, lake_memory_model_release); \
+        } \
+        __n; \
+    })
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,72 @@
+/*  ----------------------------------------------------------------------------------
+ *  |    0    |    1    |    2    |    3    |    4     |    5    |    6    |    7    |
+ *  ----------------------------------------------------------------------------------
+ *  |   0x0   |   0x4   |   0x8   |   0xc   |   0x10   |   0x14  |   0x18  |   0x1c  |
+ *  ----------------------------------------------------------------------------------
+ *  | fc_mxcsr|fc_x87_cw|        R12        |         R13        |        R14        |
+ *  ----------------------------------------------------------------------------------
+ *  ----------------------------------------------------------------------------------
+ *  |    8    |    9    |   10    |   11    |    12    |    13   |    14   |    15   |
+ *  ----------------------------------------------------------------------------------
+ *  |   0x20  |   0x24  |   0x28  |  0x2c   |   0x30   |   0x34  |   0x38  |   0x3c  |
+ *  ----------------------------------------------------------------------------------
+ *  |        R15        |        RBX        |         RBP        |        RIP        |
+ *  ----------------------------------------------------------------------------------
+ *  ----------------------------------------------------------------------------------
+ *  |    16   |   17    |                                                            |
+ *  ----------------------------------------------------------------------------------
+ *  |   0x40  |   0x44  |                                                            |
+ *  ----------------------------------------------------------------------------------
+ *  |        EXIT       |                                                            |
+ *  ----------------------------------------------------------------------------------
+ */
+
+/* Switches into a context that make_fcontext has just made on this thread. The old context 
+ * is saved the same as by jump_fcontext with preserve_fpu, so it may be resumed by either. 
+ * The new context holds no registers yet, and it's FPU control words were copied from this 
+ * thread, so only the return address is loaded. Restoring MXCSR and the x87 control word 
+ * is the slow part of a switch, as both instructions serialize parts of the pipeline. */
+
+.file "jump_fresh_fcontext_amd64_sysv_elf.s"
+.text
+.globl jump_fcontext_fresh
+.type jump_fcontext_fresh,@function
+.align 16
+
+jump_fcontext_fresh:
+    pushq   %rbp /* save RBP */
+    pushq   %rbx /* save RBX */
+    pushq   %r15 /* save R15 */
+    pushq   %r14 /* save R14 */
+    pushq   %r13 /* save R13 */
+    pushq   %r12 /* save R12 */
+
+    /* prepare stack for FPU */
+    leaq    -0x8(%rsp), %rsp
+
+    /* save MMX control-word and status-word, the old context may be resumed by jump_fcontext */
+    stmxcsr (%rsp)
+
+    /* save x87 control-word */
+    fnstcw  0x4(%rsp)
+
+    /* store RSP (pointing to context-data) in RDI */
+    movq    %rsp, (%rdi)
+
+    /* load the address of the context-function, R12 .. RBP are not set by make_fcontext */
+    movq    0x38(%rsi), %r8
+
+    /* RSP points to the return-address of the context-function, as after the pop of RIP */
+    leaq    0x40(%rsi), %rsp
+
+    /* use third arg as return-value after jump */
+    movq    %rdx, %rax
+
+    /* use third arg as first arg in context function */
+    movq    %rdx, %rdi
+
+    /* indirect jump to context */
+    jmp     *%r8
+.size jump_fcontext_fresh,.-jump_fcontext_fresh
+/* mark that we don't need executable stack */
+.section .note.GNU-stack,"",%progbits
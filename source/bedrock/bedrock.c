@@ -29,14 +29,56 @@ static LAKE_NORETURN void LAKECALL funny_valentine(void *raw_app)
 
     /* tell all threads to die, type shit */
     for (s32 i = 0; i < g_bedrock->thread_count; i++) {
-        g_bedrock->ends[i].procedure = d4c_love_train;
-        g_bedrock->ends[i].argument = nullptr;
-        g_bedrock->ends[i].name = "bedrock/ends";
+        g_bedrock->ends[i] = (lake_work_details){
+            .procedure = d4c_love_train,
+            .argument = nullptr,
+            .name = "bedrock/ends",
+        };
     }
     lake_submit_work_and_yield(g_bedrock->thread_count, g_bedrock->ends);
     LAKE_UNREACHABLE;
 }
 
+/** Returns true if `a` should go before `b` in the worker placement order. */
+static bool cpu_topology_before(struct cpu_topology const *a, bool a_sibling,
+                                struct cpu_topology const *b, bool b_sibling)
+{
+    if (a_sibling != b_sibling) return !a_sibling;
+    if (a->capacity != b->capacity) return a->capacity > b->capacity;
+    if (a->package != b->package) return a->package < b->package;
+    if (a->domain != b->domain) return a->domain < b->domain;
+    return a->cpu < b->cpu;
+}
+
+void cpu_topology_order(struct cpu_topology *topology, s32 count)
+{
+    if (count <= 1) return;
+    bool *sibling = __lake_malloc_n(bool, count);
+
+    for (s32 i = 0; i < count; i++) {
+        sibling[i] = false;
+        for (s32 j = 0; j < i; j++) {
+            if (topology[j].core == topology[i].core && topology[j].package == topology[i].package) {
+                sibling[i] = true;
+                break;
+            }
+        }
+    }
+    /* there are a few hundred CPUs at most, an insertion sort will do */
+    for (s32 i = 1; i < count; i++) {
+        struct cpu_topology t = topology[i];
+        bool sib = sibling[i];
+        s32 j = i - 1;
+        for (; j >= 0 && cpu_topology_before(&t, sib, &topology[j], sibling[j]); j--) {
+            topology[j + 1] = topology[j];
+            sibling[j + 1] = sibling[j];
+        }
+        topology[j + 1] = t;
+        sibling[j + 1] = sib;
+    }
+    __lake_free(sibling);
+}
+
 static void LAKECALL bedrock_init(lake_bedrock *bedrock)
 {
     sys_meminfo(&bedrock->host.total_ram, &bedrock->host.page_size);
@@ -44,6 +86,31 @@ static void LAKECALL bedrock_init(lake_bedrock *bedrock)
         bedrock->hints.memory_budget = lake_align(bedrock->host.total_ram, 8lu*LAKE_TAGGED_HEAP_BLOCK_SIZE);
 
     sys_cpuinfo(&bedrock->host.cpu_thread_count, &bedrock->host.cpu_cores_count, &bedrock->host.cpu_package_count);
+    /* worker placement follows the topology, it also corrects the counts read above */
+    s32 topology_count = lake_max(sys_cpu_topology(nullptr, 0), bedrock->host.cpu_thread_count);
+    struct cpu_topology *topology = __lake_malloc_n(struct cpu_topology, topology_count);
+    topology_count = sys_cpu_topology(topology, topology_count);
+    if (topology_count > 0) {
+        s32 cores = 0, packages = 0;
+        for (s32 i = 0; i < topology_count; i++) {
+            bool new_core = true, new_package = true;
+            for (s32 j = 0; j < i; j++) {
+                if (topology[j].package == topology[i].package) {
+                    new_package = false;
+                    if (topology[j].core == topology[i].core) new_core = false;
+                }
+            }
+            cores += new_core;
+            packages += new_package;
+        }
+        bedrock->host.cpu_thread_count = topology_count;
+        bedrock->host.cpu_cores_count = cores;
+        bedrock->host.cpu_package_count = packages;
+    } else {
+        topology_count = bedrock->host.cpu_thread_count;
+        for (s32 i = 0; i < topology_count; i++)
+            topology[i] = (struct cpu_topology){ .cpu = i, .core = i, .package = 0, .domain = 0, .capacity = 1024 };
+    }
     if (bedrock->hints.worker_thread_count == 0 || bedrock->hints.worker_thread_count > (u32)bedrock->host.cpu_thread_count)
         bedrock->hints.worker_thread_count = bedrock->host.cpu_thread_count;
 
@@ -54,54 +121,118 @@ static void LAKECALL bedrock_init(lake_bedrock *bedrock)
 
     if (bedrock->hints.tagged_heap_count == 0)
         bedrock->hints.tagged_heap_count = 32;
+    if (bedrock->hints.tagged_heap_high_water_mark == 0)
+        bedrock->hints.tagged_heap_high_water_mark = lake_align(bedrock->hints.memory_budget >> 3, LAKE_TAGGED_HEAP_BLOCK_SIZE);
     if (bedrock->hints.fiber_stack_size == 0)
         bedrock->hints.fiber_stack_size = 64lu * 1024;
     if (bedrock->hints.fiber_count == 0)
         bedrock->hints.fiber_count = 96 + 4 * bedrock->hints.worker_thread_count;
+    if (bedrock->hints.fiber_stack_size_small == 0)
+        bedrock->hints.fiber_stack_size_small = 16lu * 1024;
+    if (bedrock->hints.fiber_count_small == 0)
+        bedrock->hints.fiber_count_small = bedrock->hints.fiber_count;
+    if (bedrock->hints.fiber_stack_size_large == 0)
+        bedrock->hints.fiber_stack_size_large = 256lu * 1024;
+    if (bedrock->hints.fiber_count_large == 0)
+        bedrock->hints.fiber_count_large = 8 + bedrock->hints.worker_thread_count;
+
+    u32 const fiber_counts[lake_fiber_stack_count] = {
+        [lake_fiber_stack_normal] = bedrock->hints.fiber_count,
+        [lake_fiber_stack_small] = bedrock->hints.fiber_count_small,
+        [lake_fiber_stack_large] = bedrock->hints.fiber_count_large,
+    };
+    u32 const fiber_stack_sizes[lake_fiber_stack_count] = {
+        [lake_fiber_stack_normal] = bedrock->hints.fiber_stack_size,
+        [lake_fiber_stack_small] = bedrock->hints.fiber_stack_size_small,
+        [lake_fiber_stack_large] = bedrock->hints.fiber_stack_size_large,
+    };
+    u32 const fiber_total = fiber_counts[0] + fiber_counts[1] + fiber_counts[2];
+
+    if (bedrock->hints.work_chain_count == 0)
+        bedrock->hints.work_chain_count = fiber_total;
+    if (bedrock->hints.timer_count == 0)
+        bedrock->hints.timer_count = 2 * fiber_total;
     if (bedrock->hints.log2_work_count == 0)
         bedrock->hints.log2_work_count = 11; /* 2048 */
+    if (bedrock->hints.log2_deque_work_count == 0)
+        bedrock->hints.log2_deque_work_count = 8; /* 256 */
+    if (bedrock->hints.log2_io_request_count == 0)
+        bedrock->hints.log2_io_request_count = 8; /* 256 */
     if (bedrock->hints.frames_in_flight == 0)
         bedrock->hints.frames_in_flight = 1;
     bedrock->timer_start = lake_rtc_counter();
 
     work_queue_node *work_nodes = nullptr;
+    struct work *deque_nodes = nullptr;
+    lake_mpmc_node *ready_nodes = nullptr;
     struct region *roots_pages = nullptr;
     usize const roots_page_count = 8;
 
     usize const bedrock_bytes           = lake_align(sizeof(struct bedrock), LAKE_CACHELINE_SIZE);
     usize const work_count              = 1lu << bedrock->hints.log2_work_count;
-    usize const work_nodes_bytes        = lake_align(sizeof(work_queue_node) * work_count, 16);
+    usize const work_nodes_bytes        = lake_align(sizeof(work_queue_node) * work_count, 16) * lake_work_priority_count;
+    usize const deque_count             = WORK_DEQUE_PRIORITY_COUNT * bedrock->hints.worker_thread_count;
+    usize const deques_bytes            = lake_align(sizeof(struct work_deque) * deque_count, LAKE_CACHELINE_SIZE);
+    usize const stats_bytes             = lake_align(sizeof(struct worker_stats) * bedrock->hints.worker_thread_count, LAKE_CACHELINE_SIZE);
+    usize const machina_bytes           = lake_align(sizeof(struct machina_cache) * bedrock->hints.worker_thread_count, LAKE_CACHELINE_SIZE);
+    usize const heap_caches_bytes       = lake_align(sizeof(struct tagged_heap_cache) * bedrock->hints.worker_thread_count, LAKE_CACHELINE_SIZE);
+    usize const deque_work_count        = 1lu << bedrock->hints.log2_deque_work_count;
+    usize const deque_nodes_bytes       = lake_align(sizeof(struct work) * deque_work_count * deque_count, 16);
     usize const roots_pages_bytes       = lake_align(sizeof(struct region) * roots_page_count, 16);
     usize const tls_bytes               = lake_align(sizeof(struct tls) * bedrock->hints.worker_thread_count, 16);
     usize const ends_bytes              = lake_align(sizeof(lake_work_details) * bedrock->hints.worker_thread_count, 16);
     usize const threads_bytes           = lake_align(sizeof(sys_thread_id) * bedrock->hints.worker_thread_count, 16);
-    usize const fibers_bytes            = lake_align(sizeof(struct fiber) * bedrock->hints.fiber_count, 16);
-    usize const waiting_bytes           = lake_align(sizeof(atomic_usize) * bedrock->hints.fiber_count, 16);
-    usize const free_bytes              = lake_align(sizeof(atomic_usize) * bedrock->hints.fiber_count, 16);
-    usize const locks_bytes             = lake_align(sizeof(atomic_usize) * bedrock->hints.fiber_count, 16);
+    usize thread_lookup_count = 1lu;
+    while (thread_lookup_count < 2lu * bedrock->hints.worker_thread_count) thread_lookup_count <<= 1;
+    usize const thread_lookup_bytes     = lake_align(sizeof(s32) * thread_lookup_count, 16);
+    usize const fibers_bytes            = lake_align(sizeof(struct fiber) * fiber_total, 16);
+    usize ready_count = 1lu;
+    while (ready_count < 2lu * fiber_total) ready_count <<= 1;
+    usize const ready_nodes_bytes       = lake_align(sizeof(lake_mpmc_node) * ready_count, 16);
+    usize const free_bytes              = lake_align(sizeof(atomic_u32) * fiber_total, 16);
+    usize const chains_bytes            = lake_align(sizeof(struct chain) * bedrock->hints.work_chain_count, LAKE_CACHELINE_SIZE);
+    usize const timers_bytes            = lake_align(sizeof(struct timer) * bedrock->hints.timer_count, 16);
     usize const heap_bytes              = lake_align(sizeof(struct tagged_heap), 16);
     usize const tagged_heap_bytes       = heap_bytes * bedrock->hints.tagged_heap_count;
     usize const tagged_heap_array_bytes = lake_align(sizeof(struct tagged_heap *) * bedrock->hints.tagged_heap_count, 16);
+    usize heap_lookup_count = 1lu;
+    while (heap_lookup_count < 2lu * bedrock->hints.tagged_heap_count) heap_lookup_count <<= 1;
+    usize const heap_lookup_bytes       = lake_align(sizeof(atomic_uptr) * heap_lookup_count, 16);
     usize const block_count             = __position_from_block(bedrock->hints.memory_budget); 
-    usize const heap_bitmap_bytes       = lake_align(__index_from_position(block_count), 16);
-    usize const stack_bytes             = lake_align(bedrock->hints.fiber_stack_size, 16);
-    usize const stack_heap_bytes        = stack_bytes * bedrock->hints.fiber_count;
+    usize const bitmap_word_count       = __index_from_position(block_count + 63);
+    usize const heap_bitmap_bytes       = lake_align(sizeof(u64) * bitmap_word_count, 16);
+    usize const bitmap_summary_bytes    = lake_align(sizeof(u64) * ((bitmap_word_count + 63) >> 6), 16);
+    /* every stack is preceded by a guard page, stacks grow downwards into it */
+    usize const guard_bytes             = bedrock->host.page_size;
+    usize stack_heap_bytes              = 0;
+    for (s32 i = 0; i < lake_fiber_stack_count; i++)
+        stack_heap_bytes += (guard_bytes + lake_align(fiber_stack_sizes[i], guard_bytes)) * fiber_counts[i];
 
-    usize const roots_bytes = 
+    usize const stack_heap_offset = lake_align(
         bedrock_bytes +
+        deques_bytes +
+        stats_bytes +
+        machina_bytes +
+        heap_caches_bytes +
+        chains_bytes +
         work_nodes_bytes +
+        deque_nodes_bytes +
         roots_pages_bytes +
         tls_bytes +
         ends_bytes +
         threads_bytes +
+        thread_lookup_bytes +
         fibers_bytes +
-        waiting_bytes +
+        ready_nodes_bytes +
         free_bytes +
-        locks_bytes +
+        timers_bytes +
         tagged_heap_bytes +
         tagged_heap_array_bytes +
-        heap_bitmap_bytes +
-        stack_heap_bytes;
+        heap_lookup_bytes +
+        heap_bitmap_bytes * 3 +
+        bitmap_summary_bytes, 
+        guard_bytes);
+    usize const roots_bytes = stack_heap_offset + stack_heap_bytes;
     usize const roots_block_aligned = lake_align(roots_bytes, LAKE_TAGGED_HEAP_BLOCK_SIZE);
     usize commitment = lake_min(lake_align(roots_block_aligned, 8lu*LAKE_TAGGED_HEAP_BLOCK_SIZE), bedrock->hints.memory_budget);
 
@@ -110,21 +241,35 @@ static void LAKECALL bedrock_init(lake_bedrock *bedrock)
         lake_fatal("Can't map internal framework memory.");
         lake_abort(LAKE_ERROR_MEMORY_MAP_FAILED);
     }
-    lake_memset(g_bedrock, 0u, commitment);
+    /* stacks are left untouched, their pages are committed on first use */
+    lake_memset(g_bedrock, 0u, stack_heap_offset);
 
     g_bedrock->thread_count = bedrock->hints.worker_thread_count;
-    g_bedrock->fiber_count = bedrock->hints.fiber_count;
+    g_bedrock->fiber_count = (s32)fiber_total;
+    g_bedrock->chain_count = bedrock->hints.work_chain_count;
     g_bedrock->tagged_heap_count = bedrock->hints.tagged_heap_count;
     g_bedrock->budget = bedrock->hints.memory_budget;
     g_bedrock->page_size = bedrock->hints.page_size_in_use;
+    g_bedrock->high_water_mark = bedrock->hints.tagged_heap_high_water_mark;
     lake_atomic_init(&g_bedrock->commitment, commitment);
-    g_bedrock->stack_size = stack_bytes;
 
     u8 *raw = (u8 *)g_bedrock;
     usize o = bedrock_bytes;
 
+    g_bedrock->deques = (struct work_deque *)&raw[o];
+    o += deques_bytes;
+    g_bedrock->stats = (struct worker_stats *)&raw[o];
+    o += stats_bytes;
+    g_bedrock->machina = (struct machina_cache *)&raw[o];
+    o += machina_bytes;
+    g_bedrock->heap_caches = (struct tagged_heap_cache *)&raw[o];
+    o += heap_caches_bytes;
+    g_bedrock->chains = (struct chain *)&raw[o]; 
+    o += chains_bytes;
     work_nodes = (work_queue_node *)&raw[o]; 
     o += work_nodes_bytes;
+    deque_nodes = (struct work *)&raw[o];
+    o += deque_nodes_bytes;
     roots_pages = (struct region *)&raw[o]; 
     o += roots_pages_bytes;
     g_bedrock->tls = (struct tls *)&raw[o]; 
@@ -133,24 +278,54 @@ static void LAKECALL bedrock_init(lake_bedrock *bedrock)
     o += ends_bytes;
     g_bedrock->threads = (sys_thread_id *)&raw[o]; 
     o += threads_bytes;
+    g_bedrock->thread_lookup = (s32 *)&raw[o];
+    g_bedrock->thread_lookup_mask = (u32)thread_lookup_count - 1;
+    o += thread_lookup_bytes;
     g_bedrock->fibers = (struct fiber *)&raw[o]; 
     o += fibers_bytes;
-    g_bedrock->waiting = (atomic_usize *)&raw[o]; 
-    o += waiting_bytes;
-    g_bedrock->free = (atomic_usize *)&raw[o]; 
+    ready_nodes = (lake_mpmc_node *)&raw[o];
+    o += ready_nodes_bytes;
+    g_bedrock->free = (atomic_u32 *)&raw[o]; 
     o += free_bytes;
-    g_bedrock->locks = (atomic_usize *)&raw[o]; 
-    o += locks_bytes;
+    g_bedrock->timers.pool = (struct timer *)&raw[o];
+    g_bedrock->timers.pool_count = (s32)bedrock->hints.timer_count;
+    o += timers_bytes;
     g_bedrock->tagged_heaps = (struct tagged_heap **)&raw[o];
     o += tagged_heap_array_bytes;
     for (s32 i = 0; i < g_bedrock->tagged_heap_count; i++) {
         g_bedrock->tagged_heaps[i] = (struct tagged_heap *)&raw[o];
         o += heap_bytes;
     }
-    g_bedrock->bitmap = (atomic_u8 *)&raw[o];
+    g_bedrock->tagged_heap_free_count = (usize)g_bedrock->tagged_heap_count;
+    g_bedrock->heap_lookup = (atomic_uptr *)&raw[o];
+    g_bedrock->heap_lookup_mask = (u32)heap_lookup_count - 1;
+    g_bedrock->heap_lookup_lock = (lake_spinlock)lake_spinlock_init;
+    o += heap_lookup_bytes;
+    g_bedrock->bitmap = (atomic_u64 *)&raw[o];
     o += heap_bitmap_bytes;
-    g_bedrock->stack = (u8 *)&raw[o];
-    o += stack_heap_bytes;
+    g_bedrock->bitmap_summary = (atomic_u64 *)&raw[o];
+    o += bitmap_summary_bytes;
+    g_bedrock->bitmap_dirty = (atomic_u64 *)&raw[o];
+    o += heap_bitmap_bytes;
+    g_bedrock->bitmap_idle = (atomic_u64 *)&raw[o];
+    o += heap_bitmap_bytes;
+    o = stack_heap_offset;
+    for (s32 c = 0, fiber_idx = 0; c < lake_fiber_stack_count; c++) {
+        usize const stack_bytes = lake_align(fiber_stack_sizes[c], guard_bytes);
+        g_bedrock->stack_size[c] = stack_bytes;
+
+        for (u32 i = 0; i < fiber_counts[c]; i++, fiber_idx++) {
+            struct fiber *fiber = &g_bedrock->fibers[fiber_idx];
+            if (!sys_guard_pages(g_bedrock, o, guard_bytes)) {
+                lake_fatal("Can't protect the guard page of a fiber stack.");
+                lake_abort(LAKE_ERROR_MEMORY_MAP_FAILED);
+            }
+            fiber->stack = &raw[o + guard_bytes];
+            fiber->stack_class = (lake_fiber_stack)c;
+            fiber->pinned_to = -1;
+            o += guard_bytes + stack_bytes;
+        }
+    }
 
     g_bedrock->roots.tail = &g_bedrock->roots.head;
     for (u32 i = 0; i < roots_page_count; i++)
@@ -160,44 +335,109 @@ static void LAKECALL bedrock_init(lake_bedrock *bedrock)
     g_bedrock->roots.head.alloc = roots_block_aligned;
     g_bedrock->roots.tail = &g_bedrock->roots.head;
 
-    /* bits set to 1 means free blocks */
-    lake_memset(g_bedrock->bitmap, 0xff, heap_bitmap_bytes);
-    acquire_heap_bitmap(g_bedrock->bitmap, 0, roots_block_aligned);
+    /* bits set to 1 means free blocks, the bitmap is zeroed so bits past the budget stay in use */
+    release_heap_bitmap(0, __block_from_position(block_count));
+    acquire_heap_bitmap(0, roots_block_aligned);
 
+    lake_dbg_assert(!(((sptr)g_bedrock->deques)         & (LAKE_CACHELINE_SIZE-1)), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)g_bedrock->stats)          & (LAKE_CACHELINE_SIZE-1)), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)g_bedrock->machina)        & (LAKE_CACHELINE_SIZE-1)), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)g_bedrock->heap_caches)    & (LAKE_CACHELINE_SIZE-1)), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)g_bedrock->chains)         & (LAKE_CACHELINE_SIZE-1)), LAKE_PANIC, nullptr);
     lake_dbg_assert(!(((sptr)work_nodes)                & 15), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)deque_nodes)               & 15), LAKE_PANIC, nullptr);
     lake_dbg_assert(!(((sptr)roots_pages)               & 15), LAKE_PANIC, nullptr);
     lake_dbg_assert(!(((sptr)g_bedrock->tls)            & 15), LAKE_PANIC, nullptr);
     lake_dbg_assert(!(((sptr)g_bedrock->ends)           & 15), LAKE_PANIC, nullptr);
     lake_dbg_assert(!(((sptr)g_bedrock->threads)        & 15), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)g_bedrock->thread_lookup)  & 15), LAKE_PANIC, nullptr);
     lake_dbg_assert(!(((sptr)g_bedrock->fibers)         & 15), LAKE_PANIC, nullptr);
-    lake_dbg_assert(!(((sptr)g_bedrock->waiting)        & 15), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)ready_nodes)               & 15), LAKE_PANIC, nullptr);
     lake_dbg_assert(!(((sptr)g_bedrock->free)           & 15), LAKE_PANIC, nullptr);
-    lake_dbg_assert(!(((sptr)g_bedrock->locks)          & 15), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)g_bedrock->timers.pool)    & 15), LAKE_PANIC, nullptr);
     lake_dbg_assert(!(((sptr)g_bedrock->tagged_heaps)   & 15), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)g_bedrock->heap_lookup)    & 15), LAKE_PANIC, nullptr);
     lake_dbg_assert(!(((sptr)g_bedrock->bitmap)         & 15), LAKE_PANIC, nullptr);
-    lake_dbg_assert(!(((sptr)g_bedrock->stack)          & 15), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)g_bedrock->bitmap_summary) & 15), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)g_bedrock->bitmap_dirty)   & 15), LAKE_PANIC, nullptr);
+    lake_dbg_assert(!(((sptr)g_bedrock->bitmap_idle)    & 15), LAKE_PANIC, nullptr);
 
-    lake_mpmc_init_t(&g_bedrock->work_queue, work_queue_node, work_count, work_nodes);
+    for (s32 i = 0; i < lake_work_priority_count; i++) {
+        lake_mpmc_init_t(&g_bedrock->work_queue[i], work_queue_node, work_count, &work_nodes[i * work_count]);
+        g_bedrock->work_overflow[i] = (struct work_overflow){ .lock = lake_spinlock_init };
+    }
+    lake_mpmc_init_t(&g_bedrock->ready_queue, lake_mpmc_node, ready_count, ready_nodes);
 
-    for (s32 i = 0; i < g_bedrock->fiber_count; i++) {
-        lake_atomic_init(&g_bedrock->free[i], i);
-        lake_atomic_init(&g_bedrock->locks[i], FIBER_INVALID);
-        lake_atomic_init(&g_bedrock->waiting[i], FIBER_INVALID);
+    for (usize i = 0; i < deque_count; i++) {
+        struct work_deque *deque = &g_bedrock->deques[i];
+        deque->buffer = &deque_nodes[i * deque_work_count];
+        deque->buffer_mask = (ssize)deque_work_count - 1;
+        lake_atomic_init(&deque->top, 0);
+        lake_atomic_init(&deque->bottom, 0);
     }
-    g_bedrock->tls[0].fiber_in_use = (u32)get_free_fiber();
+    /* any non-zero seed will do for xorshift */
+    for (s32 i = 0; i < g_bedrock->thread_count; i++) {
+        g_bedrock->tls[i].steal_seed = 0x9e3779b9u * (u32)(i + 1);
+        g_bedrock->tls[i].spin_limit = PARK_SPIN_MAX;
+        g_bedrock->tls[i].domain = topology[i % topology_count].domain;
+        g_bedrock->tls[i].pinned = (struct work_overflow){ .lock = lake_spinlock_init };
+        g_bedrock->tls[i].stats = &g_bedrock->stats[i];
+        lake_atomic_init(&g_bedrock->tls[i].pinned_ready, (u64)FREE_LIST_END);
+        lake_atomic_init(&g_bedrock->tls[i].park_epoch, 0u);
+        lake_atomic_init(&g_bedrock->tls[i].parked, 0u);
+
+        bool new_domain = true;
+        for (s32 j = 0; j < i && new_domain; j++)
+            new_domain = g_bedrock->tls[j].domain != g_bedrock->tls[i].domain;
+        g_bedrock->domain_count += new_domain;
+    }
+
+    /* fibers of every stack class are linked into their own free stack */
+    for (s32 c = 0, first = 0; c < lake_fiber_stack_count; c++) {
+        s32 const end = first + (s32)fiber_counts[c];
+        for (s32 i = first; i < end; i++)
+            lake_atomic_init(&g_bedrock->free[i], (i + 1 < end) ? (u32)(i + 1) : FREE_LIST_END);
+        lake_atomic_init(&g_bedrock->free_head[c], (u64)(first < end ? (u32)first : FREE_LIST_END));
+        first = end;
+    }
+    for (s32 i = 0; i < g_bedrock->chain_count; i++) {
+        struct chain *chain = &g_bedrock->chains[i];
+        lake_atomic_init(&chain->counter, 0lu);
+        lake_atomic_init(&chain->waiter, CHAIN_DROPPED);
+        lake_atomic_init(&chain->generation, 1u);
+        lake_atomic_init(&chain->next, (i + 1 < g_bedrock->chain_count) ? (u32)(i + 1) : FREE_LIST_END);
+    }
+    lake_atomic_init(&g_bedrock->chain_head, 0llu);
+
+    struct timer_wheel *timers = &g_bedrock->timers;
+    for (s32 i = 0; i < timers->pool_count; i++)
+        timers->pool[i].next = (i + 1 < timers->pool_count) ? &timers->pool[i + 1] : nullptr;
+    timers->free = timers->pool_count > 0 ? &timers->pool[0] : nullptr;
+    timers->lock = (lake_spinlock)lake_spinlock_init;
+    timers->tick = lake_time_ns() >> TIMER_TICK_SHIFT;
+    lake_atomic_init(&timers->count, 0u);
+    lake_atomic_init(&timers->next_tick, UINT64_MAX);
+
+    g_bedrock->io_request_count = 1u << bedrock->hints.log2_io_request_count;
+    g_bedrock->io_ring = sys_io_ring_create(g_bedrock->io_request_count);
+    lake_atomic_init(&g_bedrock->io_inflight, 0u);
+    g_bedrock->tls[0].fiber_in_use = (u32)get_free_fiber(lake_fiber_stack_normal);
 #if defined(LAKE_PLATFORM_UNIX)
     g_bedrock->threads[0] = (sys_thread_id)pthread_self();
 #elif defined(LAKE_PLATFORM_WINDOWS)
     g_bedrock->threads[0] = (sys_thread_id)GetCurrentThreadId();
 #endif /* LAKE_PLATFORM_UNIX */
+    register_worker_thread(0);
 
     lake_atomic_write_explicit(&g_bedrock->tls_sync, 0lu, lake_memory_model_release);
     for (s32 i = 1; i < g_bedrock->thread_count; i++) {
         struct tls *tls = &g_bedrock->tls[i];
         tls->fiber_in_use = (u32)FIBER_INVALID;
         sys_thread_create(&g_bedrock->threads[i], dirty_deeds_done_dirt_cheap, (void *)tls);
+        register_worker_thread(i);
     }
-    sys_thread_affinity(g_bedrock->thread_count, g_bedrock->threads, bedrock->host.cpu_thread_count, 0);
+    sys_thread_affinity(g_bedrock->thread_count, g_bedrock->threads, topology, topology_count);
+    __lake_free(topology);
     lake_atomic_write_explicit(&g_bedrock->tls_sync, 1lu, lake_memory_model_release);
 }
 
@@ -217,12 +457,16 @@ s32 lake_in_the_lungs(
         .procedure = funny_valentine,
         .argument = (void *)&app,
         .name = bedrock->engine_name,
+        /* the application can go deep into the call stack, e.g. initializing drivers */
+        .stack = lake_fiber_stack_large,
     };
 
     lake_submit_work(1, &work, nullptr);
     dirty_deeds_done_dirt_cheap((void *)&g_bedrock->tls[0]);
     /* won't resume until the application returns */
 
+    release_work_overflow();
+    sys_io_ring_destroy(g_bedrock->io_ring);
     sys_munmap(g_bedrock, g_bedrock->budget);
     g_bedrock = nullptr;
 
@@ -5,6 +5,12 @@
 #include <lake/data_structures/strbuf.h>
 
 #define FIBER_INVALID (SIZE_MAX)
+/** Written into the waiter of a chain, after the chain dropped to zero. */
+#define CHAIN_DROPPED (SIZE_MAX - 1)
+/** Written into the waiter of a chain, when work was submitted to run after it. */
+#define CHAIN_CONTINUED (SIZE_MAX - 2)
+/** Terminates the free stacks of fibers and chains. */
+#define FREE_LIST_END (UINT32_MAX)
 
 /** Thread-local storage. */
 struct tls;
@@ -16,6 +22,12 @@ typedef void *fcontext;
 LAKE_HOT_FN
 extern sptr jump_fcontext(fcontext *ofc, fcontext nfc, sptr vp, s32 preserve_fpu);
 
+/** Implemented in assembly, switches into a context that `make_fcontext()` has just made on the 
+ *  calling thread. It skips restoring registers and the FPU control words of the new context, 
+ *  as there is nothing there to restore. The old context is saved with it's FPU state. */
+LAKE_HOT_FN
+extern sptr jump_fcontext_fresh(fcontext *ofc, fcontext nfc, sptr vp);
+
 /** Implemented in assembly, sp - top of stack pointer. */
 LAKE_HOT_FN LAKE_NONNULL_ALL
 extern fcontext make_fcontext(void *sp, usize size, void (*fn)(sptr));
@@ -31,17 +43,174 @@ typedef DWORD sys_thread_id;
 
 enum tls_flags : u32 {
     tls_in_use = 0u,
+    tls_to_sleep = 0x20000000u,
     tls_to_free = 0x40000000u,
     tls_to_wait = 0x80000000u,
-    tls_mask    = ~(tls_to_free | tls_to_wait),
+    tls_mask    = ~(tls_to_sleep | tls_to_free | tls_to_wait),
 };
 
+struct chain;
+
 struct work {
     lake_work_details       details;
-    atomic_usize           *work_left;
+    struct chain           *chain;
 };
 typedef lake_mpmc_t(struct work) work_queue_node;
 
+/** Work spilled into the shared queue is reserved and published in batches of this size. */
+#define WORK_SUBMIT_BATCH 64
+
+/** Work that didn't fit into a full work queue is kept in a list of heap allocated segments. 
+ *  It's unbounded, so a submission never waits for the queue to drain. Workers look into 
+ *  it only when the count is non-zero, and the segments are freed once they were drained. */
+#define WORK_OVERFLOW_SEGMENT_SIZE 256
+struct work_overflow_segment {
+    struct work_overflow_segment   *next;
+    u32                             head;
+    u32                             tail;
+    struct work                     work[WORK_OVERFLOW_SEGMENT_SIZE];
+};
+
+struct work_overflow {
+    lake_spinlock                   lock;
+    atomic_u32                      count;
+    struct work_overflow_segment   *head;
+    struct work_overflow_segment   *tail;
+};
+
+/** Every worker owns a deque per priority class, except for background work. It only goes 
+ *  through the shared queue, so it can be picked up by idle workers. */
+#define WORK_DEQUE_PRIORITY_COUNT (lake_work_priority_background)
+
+/** Timers are kept in a hierarchical timing wheel. A tick of the wheel is (1 << TIMER_TICK_SHIFT) 
+ *  nanoseconds, about 131us. Every level has 64 slots, a slot of level L spans (64^L) ticks, 
+ *  so four levels cover deadlines of up to about 36 minutes ahead, later ones are clamped. 
+ *  Timers of a higher level are cascaded down into lower levels as the wheel turns. */
+#define TIMER_TICK_SHIFT    17
+#define TIMER_SLOT_BITS     6
+#define TIMER_SLOT_COUNT    (1u << TIMER_SLOT_BITS)
+#define TIMER_LEVEL_COUNT   4
+
+/** Either resumes a sleeping fiber, or submits delayed work once the deadline is reached. */
+struct timer {
+    struct timer               *next;
+    u64                         deadline;   /**< In ticks of the wheel. */
+    u32                         fiber_idx;  /**< FIBER_INVALID for delayed work. */
+    lake_work_priority          priority;
+    struct work                 work;
+};
+
+struct timer_wheel {
+    lake_spinlock               lock;
+    /** The next tick to be processed, every timer with an earlier deadline has fired. */
+    u64                         tick;
+    /** A bit is set for every slot that holds timers. */
+    u64                         occupied[TIMER_LEVEL_COUNT];
+    struct timer               *slots[TIMER_LEVEL_COUNT][TIMER_SLOT_COUNT];
+    /** Count of pending timers, the scheduler won't look at the wheel while it's zero. */
+    atomic_u32                  count;
+    /** A lower bound of the next deadline in ticks, workers don't park past it. */
+    atomic_u64                  next_tick;
+    /** A pool of timers, free timers are linked under the lock. */
+    struct timer               *free;
+    struct timer               *pool;
+    s32                         pool_count;
+};
+
+/** Work to be submitted after a chain is dropped, the details are kept inline. */
+struct continuation {
+    lake_work_priority          priority;
+    u32                         work_count;
+    /** Counts the continued work, may be nullptr. */
+    struct chain               *chain;
+    lake_work_details           work[];
+};
+
+/** The counter of a work chain, `lake_work_chain` is a handle to it. The waiter is a handshake 
+ *  between the fiber that yields on the chain and the thread that drops it to zero, which 
+ *  pushes the waiting fiber into the ready queue. It goes from FIBER_INVALID, to either 
+ *  a fiber index (a fiber waits) or CHAIN_DROPPED (the work is done), whichever comes first.
+ *  Instead of a fiber, CHAIN_CONTINUED tells that the dropping thread must submit the work 
+ *  of the continuation, and give the chain back to the pool.
+ *
+ *  Chains are pooled in a lock-free stack. The generation is bumped every time a chain 
+ *  is returned to the pool, so handles of expired chains can be told apart from new ones. */
+struct LAKE_CACHELINE_ALIGNMENT chain {
+    atomic_usize                counter;
+    atomic_usize                waiter;
+    atomic_u32                  generation;
+    /** Index of the next free chain, valid only while this chain is in the pool. */
+    atomic_u32                  next;
+    /** Published by the waiter handshake, valid only if the waiter is CHAIN_CONTINUED. */
+    struct continuation        *continuation;
+};
+
+/** A Chase-Lev work-stealing deque, owned by a single worker thread. The owner pushes and pops 
+ *  work at the bottom end, while other workers steal from the top end. The buffer is a fixed 
+ *  power of two, when it's full the submitted work spills into the shared MPMC work queue.
+ *
+ *  "Correct and Efficient Work-Stealing for Weak Memory Models", Lê, Pop, Cohen, Zappa Nardelli.
+ *  https://fzn.fr/readings/ppopp13.pdf */
+struct LAKE_CACHELINE_ALIGNMENT work_deque {
+    atomic_ssize                top;
+    u8                      pad0[LAKE_CACHELINE_SIZE - sizeof(atomic_ssize)];
+
+    atomic_ssize                bottom;
+    u8                      pad1[LAKE_CACHELINE_SIZE - sizeof(atomic_ssize)];
+
+    struct work                *buffer;
+    ssize                       buffer_mask;
+    u8                      pad2[LAKE_CACHELINE_SIZE - sizeof(uptr) - sizeof(ssize)];
+};
+
+/** Scheduler telemetry of a worker, only it's owner writes the counters, snapshots read them 
+ *  from any thread. Every worker has it's own cacheline, so counting won't cause false sharing. */
+struct LAKE_CACHELINE_ALIGNMENT worker_stats {
+    atomic_u64                  jobs_run;
+    atomic_u64                  fiber_switches;
+    atomic_u64                  local_pops;
+    atomic_u64                  queue_dequeues;
+    atomic_u64                  steals;
+    atomic_u64                  idle_ns;
+    atomic_u64                  parks;
+    atomic_u64                  wait_polls;
+    atomic_u64                  deque_depth_max;
+};
+
+/** Small allocations of machina are served from slabs, carved from tagged heap blocks. 
+ *  Every slab holds objects of one size class, and it's owned by the worker that carved it. */
+#define MACHINA_SLAB_SIZE           (64lu*1024lu)
+/** Objects start past the slab header, at an offset aligned to the largest supported alignment. */
+#define MACHINA_SLAB_HEADER_SIZE    256lu
+#define MACHINA_MAX_SIZE            2048lu
+#define MACHINA_MAX_ALIGN           MACHINA_SLAB_HEADER_SIZE
+#define MACHINA_CLASS_COUNT         14
+#define MACHINA_MAGAZINE_CAPACITY   64u
+
+struct slab;
+
+/** A stack of free objects of one size class, taken from slabs of the worker. */
+struct magazine {
+    u32                         count;
+    void                       *objects[MACHINA_MAGAZINE_CAPACITY];
+};
+
+/** Allocator state of a worker. Other threads only push into the pending stacks, the rest 
+ *  is touched by the owner alone, so it needs no synchronization. */
+struct LAKE_CACHELINE_ALIGNMENT machina_cache {
+    /** Slabs that got objects freed by other threads, linked through `pending_next`. A slab is 
+     *  pushed by the thread that made it's remote list non-empty, the owner takes them all at once. */
+    atomic_uptr                 pending[MACHINA_CLASS_COUNT];
+    u8                      pad0[lake_align(sizeof(atomic_uptr) * MACHINA_CLASS_COUNT, LAKE_CACHELINE_SIZE) - sizeof(atomic_uptr) * MACHINA_CLASS_COUNT];
+
+    struct magazine             magazines[MACHINA_CLASS_COUNT];
+    /** Slabs that have objects left to hand out, linked through `partial_next`. */
+    struct slab                *partial[MACHINA_CLASS_COUNT];
+    /** The block that new slabs are carved from, an offset from the bedrock, or 0 if none. */
+    usize                       block;
+    usize                       block_carved;
+};
+
 struct region {
     usize           v;
     struct region  *next;
@@ -52,10 +221,47 @@ struct region {
 struct tagged_heap {
     LAKE_ATOMIC(lake_heap_tag)  tag;
     lake_spinlock               spinlock;
+    /** Bumped by `lake_thfree()`, the worker caches drop blocks of an older generation. */
+    atomic_u32                  generation;
+    /** How many blocks the next refill of a worker cache takes, it doubles up to the limit 
+     *  and starts over only with a new generation. Guarded by the spinlock. */
+    u32                         cache_refill_count;
+    /** Regions handed back by evicted cache entries, a refill takes them over before it 
+     *  acquires new blocks. It's only a hint, guarded by the spinlock. */
+    u32                         cache_returned_count;
     struct region               head;
     struct region              *tail;
 };
 
+/** How many tags a worker caches blocks for at once. */
+#define TAGGED_HEAP_CACHE_TAGS      4
+/** The most blocks a worker acquires for a tag at once, refills start from one and double. */
+#define TAGGED_HEAP_CACHE_BLOCKS    4
+/** Larger allocations take the shared path, to not waste a big part of a cached block. */
+#define TAGGED_HEAP_CACHE_MAX_SIZE  (LAKE_TAGGED_HEAP_BLOCK_SIZE >> 2)
+
+/** Blocks of a tag that only one worker allocates from. They are registered in the regions 
+ *  of the heap when acquired, so `lake_thfree()` releases them without looking at the caches. 
+ *  While cached, a region reads as full for the shared path. An evicted entry hands it's 
+ *  regions back to the heap. */
+struct tagged_heap_cache_entry {
+    struct tagged_heap         *th;
+    lake_heap_tag               tag;
+    u32                         generation;
+    u32                         reserved_count;
+    /** Bump allocation within the current region, offsets from the bedrock. */
+    struct region              *region;
+    usize                       cursor;
+    usize                       end;
+    struct region              *reserved[TAGGED_HEAP_CACHE_BLOCKS];
+};
+
+/** Touched only by the owning worker. */
+struct LAKE_CACHELINE_ALIGNMENT tagged_heap_cache {
+    struct tagged_heap_cache_entry entries[TAGGED_HEAP_CACHE_TAGS];
+    u32                         victim;
+};
+
 struct drifter_cursor {
     struct drifter_cursor      *prev;
     struct region              *tail;
@@ -72,8 +278,38 @@ struct tls {
     fcontext                    home_context;
     u32                         fiber_in_use;
     u32                         fiber_old;
+    /** State of a xorshift generator, used to pick victims for work stealing. */
+    u32                         steal_seed;
+    /** How many times the worker looks for work before it parks. It grows when spinning 
+     *  paid off, and shrinks when the worker had to park anyway. */
+    u32                         spin_limit;
+    /** The last level cache domain of the worker, thieves prefer victims from the same one. */
+    s32                         domain;
+    /** Work taken by a finished fiber that couldn't run it, as it needs a larger stack. */
+    bool                        has_handoff;
+    struct work                 handoff;
+    /** Work submitted with `lake_submit_work_on()`, only this worker takes it. */
+    struct work_overflow        pinned;
+    /** Telemetry counters, see `lake_worker_stats_snapshot()`. */
+    struct worker_stats        *stats;
+    /** Fibers pinned to this worker that are ready to resume. It's a Treiber stack linked 
+     *  through the free list of fibers, as a waiting fiber is never in the free list. */
+    atomic_u64                  pinned_ready;
+    /** The idle worker parks on this futex word, it's bumped by whoever wakes the worker up. */
+    atomic_u32                  park_epoch;
+    /** Set while the worker parks, the first waker to clear it is the one to wake it up. */
+    atomic_u32                  parked;
 };
 
+/** Bounds of the adaptive spinning of idle workers. */
+#define PARK_SPIN_MIN 16u
+#define PARK_SPIN_MAX 1024u
+/** A worker that holds a fiber not yet registered as a waiter can't rely on being woken up, 
+ *  as the chain could be dropped with no one to resume. It parks only for this long. */
+#define PARK_TIMEOUT_NS 100000llu
+/** Completions of I/O requests are reaped in batches of this size. */
+#define IO_REAP_BATCH 32
+
 struct logger {
     lake_strbuf                 buf;
     struct drifter_cursor      *tail_cursor;
@@ -85,37 +321,91 @@ struct logger {
 struct fiber {
     struct work                 work;
     fcontext                    context;
-    lake_work_chain             wait_counter;
+    struct chain               *wait_chain;
+    /** The lowest address of the stack, right above the guard page. */
+    u8                         *stack;
+    lake_fiber_stack            stack_class;
+    void                       *fls[LAKE_FLS_SLOT_COUNT];
+    /** Deadline of a sleeping fiber, in nanoseconds. */
+    u64                         sleep_deadline;
+    /** Index of the worker a yielding fiber must resume on, or -1. */
+    s32                         pinned_to;
     struct drifter_cursor       cursor;
     struct drifter              drifter;
     struct logger               logger;
 };
 
 struct bedrock {
-    lake_mpmc                   work_queue;
+    lake_mpmc                   work_queue[lake_work_priority_count];
+    struct work_overflow        work_overflow[lake_work_priority_count];
+    struct timer_wheel          timers;
+    /** Asynchronous file I/O, nullptr if the host has no support for it. */
+    struct io_ring             *io_ring;
+    /** Count of requests in the ring, workers reap completions only while it's non-zero. */
+    atomic_u32                  io_inflight;
+    u32                         io_request_count;
+    /** Indexed by (thread_idx * WORK_DEQUE_PRIORITY_COUNT + priority). */
+    struct work_deque          *deques;
+    /** Indexed by the thread index, the same as TLS. */
+    struct worker_stats        *stats;
+    struct machina_cache       *machina;
+    struct tagged_heap_cache   *heap_caches;
     struct tls                 *tls;
     atomic_usize                tls_sync;
+    /** Workers park on a futex word of their own, so pinned work wakes only its worker. 
+     *  The count lets a submit skip looking for parked workers, the cursor spreads wakes. */
+    atomic_s32                  parked_count;
+    atomic_u32                  wake_cursor;
     lake_work_details          *ends;
     
-    /* TODO a hashmap to acquire worker thread index */
+    /** An open addressed hash table of worker thread IDs, with a slot holding the index of 
+     *  a worker thread plus one, or 0 if empty. It's at least twice the thread count. */
+    s32                        *thread_lookup;
+    u32                         thread_lookup_mask;
     sys_thread_id              *threads;
     struct fiber               *fibers;
-    atomic_usize               *waiting;
-    atomic_usize               *free;
-    atomic_usize               *locks;
+    lake_mpmc                   ready_queue;
+    /** Treiber stacks of free fibers, one per stack class. A head packs a generation tag in the upper 32 bits 
+     *  and a fiber index in the lower 32 bits. The tag is bumped with every exchange, so the 
+     *  ABA problem is avoided. Every fiber stores the index of the next free fiber. */
+    atomic_u64                  free_head[lake_fiber_stack_count];
+    atomic_u32                 *free;
+    /** A pool of work chains, the head is tagged the same way as for the free fibers. */
+    atomic_u64                  chain_head;
+    struct chain               *chains;
+    s32                         chain_count;
     s32                         thread_count;
     s32                         fiber_count;
-
-    atomic_u8                  *bitmap;
+    /** Count of distinct cache domains among the worker threads. */
+    s32                         domain_count;
+
+    /** A bit per block, set if the block is free. */
+    atomic_u64                 *bitmap;
+    /** A bit per word of the bitmap, set if the word may have free blocks. */
+    atomic_u64                 *bitmap_summary;
+    /** A bit per block, set if the block was in use since it's pages were last returned to the host. */
+    atomic_u64                 *bitmap_dirty;
+    /** A bit per block, set by a trim pass that saw the block free and dirty. Retiring the block clears it. */
+    atomic_u64                 *bitmap_idle;
     atomic_usize                growth_sync;
+    /** Free dirty blocks up to this size are not trimmed, see `lake_bedrock_hints`. */
+    usize                       high_water_mark;
+    /** Set while a trim pass is waiting in the timer wheel or running. */
+    atomic_u32                  trim_armed;
 
     struct tagged_heap          roots;
+    /** A stack of heaps not in use by any tag, guarded by the lookup lock. */
     struct tagged_heap        **tagged_heaps;
-    atomic_usize                tagged_heap_tail;
+    usize                       tagged_heap_free_count;
     s32                         tagged_heap_count;
-
-    u8                         *stack;
-    usize                       stack_size;
+    /** Heaps in use, open addressed by their tag with linear probing. Readers don't take the lock, 
+     *  entries are only changed under it, so a reader that misses must look again under the lock. */
+    atomic_uptr                *heap_lookup;
+    u32                         heap_lookup_mask;
+    lake_spinlock               heap_lookup_lock;
+
+    /** Stack sizes of every stack class, aligned to the page size. */
+    usize                       stack_size[lake_fiber_stack_count];
     usize                       budget;
     usize                       page_size;
     atomic_usize                commitment;
@@ -130,6 +420,14 @@ sptr jump_fiber_context(struct tls *tls, fcontext *from, fcontext *to)
     return jump_fcontext(from, *to, (sptr)tls, 1);
 }
 
+/** Same as `jump_fiber_context()`, for a context just made by `make_fiber_context()`. */
+LAKE_FORCE_INLINE LAKE_NONNULL_ALL
+sptr jump_fresh_fiber_context(struct tls *tls, fcontext *from, fcontext *to)
+{
+    lake_san_assert(*from != *to, LAKE_INVALID_PARAMETERS, "Can't switch fiber context to itself.");
+    return jump_fcontext_fresh(from, *to, (sptr)tls);
+}
+
 LAKE_FORCE_INLINE LAKE_NONNULL_ALL
 void make_fiber_context(fcontext *context, void (*procedure)(sptr), void *stack, usize stack_bytes)
 {
@@ -138,29 +436,55 @@ void make_fiber_context(fcontext *context, void (*procedure)(sptr), void *stack,
 
 /* position - a bit position, within the memory bitmap represents a single 2 MiB 
  *            (LAKE_TAGGED_HEAP_BLOCK_SIZE) block of memory using a single bit.
- *    index - an index value to access a byte within the bitmap (uint8_t per index).
- *    block - a memory offset in bytes, represents the range of a single block (1 block is 2 MiB).
- *     page - a memory offset in bytes, represents the range of a single "page" (1 page is 16 MiB, 
- *            this translates into: 1 hugepage, 1 byte worth of blocks in the bitmap). */
-#define __index_from_position(val) (val >> 3lu)
-#define __position_from_index(val) (val << 3lu)
-#define __block_from_position(val) (val << 21lu) 
-#define __position_from_block(val) (val >> 21lu)
-#define __index_from_page(val)     (val >> 24lu)
-#define __page_from_index(val)     (val << 24lu)
+ *    index - an index value to access a word within the bitmap (uint64_t per index).
+ *    block - a memory offset in bytes, represents the range of a single block (1 block is 2 MiB). */
+#define __index_from_position(val) ((val) >> 6lu)
+#define __position_from_index(val) ((val) << 6lu)
+#define __block_from_position(val) ((val) << 21lu) 
+#define __position_from_block(val) ((val) >> 21lu)
+
+/** Sets a range of blocks in the heap as in use. */
+LAKE_HOT_FN
+extern void LAKECALL acquire_heap_bitmap(usize const offset, usize const size);
 
-LAKE_HOT_FN LAKE_NONNULL_ALL
-extern void LAKECALL acquire_heap_bitmap(atomic_u8 *bitmap, usize const offset, usize const size);
+/** Sets a range of blocks in the heap as free to take. */
+LAKE_HOT_FN
+extern void LAKECALL release_heap_bitmap(usize const offset, usize const size);
 
-LAKE_HOT_FN LAKE_NONNULL_ALL
-extern void LAKECALL release_heap_bitmap(atomic_u8 *bitmap, usize const offset, usize const size);
+/** Releases a range of blocks that were in use, so their pages may be trimmed later. */
+LAKE_HOT_FN
+extern void LAKECALL retire_heap_bitmap(usize const offset, usize const size);
+
+/** Free blocks stay committed while they may be taken again soon. A trim pass runs in the 
+ *  background after `lake_thfree()`, a block it finds free and dirty is marked idle, and the 
+ *  next pass returns the pages of idle blocks to the host, but only as much as is above the 
+ *  high water mark. Passes are repeated while there is more to trim. */
+#define TAGGED_HEAP_TRIM_INTERVAL_NS (500llu * 1000llu * 1000llu)
+
+/** Arms a trim pass of free blocks, if none is armed already. */
+extern void LAKECALL arm_heap_trim(void);
 
 LAKE_HOT_FN LAKE_PURE_FN
 extern usize LAKECALL acquire_blocks(usize const block_aligned);
 
-/** Returns an index to a free fiber and grabs it's lock. */
+/** Pops an index of a free fiber from the free stack of the given stack class. If that class 
+ *  has no free fibers, a class with a larger stack is used. Returns FIBER_INVALID if none are free. */
+LAKE_HOT_FN
+extern usize LAKECALL get_free_fiber(lake_fiber_stack stack_class);
+
+/** Pushes a fiber index back onto the free stack. */
+LAKE_HOT_FN
+extern void LAKECALL put_free_fiber(usize fiber_idx);
+
+/** Frees the overflow segments left behind, pinned work included. Called once the workers have finished. */
+extern void LAKECALL release_work_overflow(void);
+
+/** Inserts the ID of a worker thread into the lookup table, called once per thread at init. */
+extern void LAKECALL register_worker_thread(s32 thread_idx);
+
+/** Returns an index of the worker thread, or -1 if called from a thread outside of the framework. */
 LAKE_HOT_FN LAKE_PURE_FN
-extern usize LAKECALL get_free_fiber(void);
+extern s32 LAKECALL find_worker_thread_index(void);
 
 LAKE_FORCE_INLINE
 struct tls *get_thread_local_storage(void)
@@ -182,9 +506,36 @@ extern void LAKECALL sys_munmap(void *mapped, usize size_page_aligned);
 /** Control state and commitment of physical resources. Offset and size must be page aligned. */
 extern bool LAKECALL sys_madvise(void *mapped, usize offset, usize size, bool commit_or_release);
 
+/** Returns physical memory of a committed range to the host, the range stays committed 
+ *  and reads as zeroes when touched again. Offset and size must be page aligned. */
+extern bool LAKECALL sys_mpurge(void *mapped, usize offset, usize size);
+
+/** Make pages inaccessible, any access will fault. Offset and size must be page aligned. */
+extern bool LAKECALL sys_guard_pages(void *mapped, usize offset, usize size);
+
 /** Read system info about the CPU. */
 extern void LAKECALL sys_cpuinfo(s32 *out_threads, s32 *out_cores, s32 *out_packages);
 
+/** Placement of a logical CPU within the physical topology of the host. */
+struct cpu_topology {
+    s32                         cpu;        /**< Logical CPU index, as used for thread affinity. */
+    s32                         core;       /**< Physical core ID, unique within a package. */
+    s32                         package;    /**< Physical package (socket) ID. */
+    s32                         domain;     /**< The lowest logical CPU that shares the last level cache. */
+    s32                         capacity;   /**< Relative core performance, up to 1024. Equal if not known. */
+};
+
+/** Orders logical CPUs for worker placement: one CPU of every physical core first (faster cores 
+ *  first), then the remaining SMT siblings. CPUs of the same package and cache domain are kept 
+ *  next to each other. A CPU is a sibling if a CPU of the same core and package comes before 
+ *  it in the given order. It doesn't touch the host, defined at `bedrock.c`. */
+extern void LAKECALL cpu_topology_order(struct cpu_topology *topology, s32 count);
+
+/** Read the topology of logical CPUs, ordered for worker placement by `cpu_topology_order()`. 
+ *  If `out` is null, returns the count of logical CPUs to expect, otherwise returns the count 
+ *  written. Returns 0 if the topology is not available. */
+extern s32 LAKECALL sys_cpu_topology(struct cpu_topology *out, s32 max_count);
+
 /** Read system info about RAM. */
 extern void LAKECALL sys_meminfo(usize *out_total_ram, usize *out_page_size);
 
@@ -203,5 +554,41 @@ extern void LAKECALL sys_thread_destroy(sys_thread_id thread);
 /** Joins a thread. It will wait for the thread to finish it's work before continuing. */
 extern void LAKECALL sys_thread_join(sys_thread_id thread);
 
-/** Set thread affinity for an array of worker threads. */
-extern void LAKECALL sys_thread_affinity(u32 thread_count, sys_thread_id const *threads, u32 cpu_count, u32 begin_cpu_idx);
+/** Set thread affinity for an array of worker threads, the thread at index `i` is pinned 
+ *  to the CPU of `topology[i % topology_count]`. */
+extern void LAKECALL sys_thread_affinity(u32 thread_count, sys_thread_id const *threads, struct cpu_topology const *topology, u32 topology_count);
+
+/** A ring of asynchronous I/O requests shared with the kernel, it's layout depends on the host. */
+struct io_ring;
+
+/** An asynchronous read or write, it lives on the stack of the fiber that waits for it. */
+struct io_request {
+    lake_work_chain             chain;      /**< Released once the request has completed. */
+    s64                         result;     /**< Bytes transferred, or a negative error code. */
+};
+
+/** Reads or writes synchronously at the given offset. Returns the bytes transferred, 
+ *  or a negative error code. */
+extern s64 LAKECALL sys_io_sync(s32 fd, void *buf, usize size, u64 offset, bool write);
+
+/** Sets up a ring for asynchronous I/O with room for at least `entries` requests. 
+ *  Returns nullptr if the host has no support for it, then I/O runs synchronously. */
+extern struct io_ring *LAKECALL sys_io_ring_create(u32 entries);
+
+/** Releases the ring, no request may be in flight. */
+extern void LAKECALL sys_io_ring_destroy(struct io_ring *ring);
+
+/** Queues a read or a write, it's chain is released by whoever reaps the completion. 
+ *  Returns false if the request could not be queued, it must be done synchronously. */
+extern bool LAKECALL sys_io_submit(struct io_ring *ring, struct io_request *request, s32 fd, void *buf, usize size, u64 offset, bool write);
+
+/** Collects completed requests with their results set, up to `max_count`. Returns the count 
+ *  of requests written, it won't wait if another thread is reaping at the same time. */
+extern u32 LAKECALL sys_io_reap(struct io_ring *ring, struct io_request **out_requests, u32 max_count);
+
+/** Blocks the thread while the value at address equals the expected value, until woken up 
+ *  or until the timeout runs out. A timeout of 0 waits with no limit. May wake spuriously. */
+extern void LAKECALL sys_futex_wait(atomic_u32 *address, u32 expected, u64 timeout_ns);
+
+/** Wakes up to `count` threads blocked on the address. */
+extern void LAKECALL sys_futex_wake(atomic_u32 *address, s32 count);
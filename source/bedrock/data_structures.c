@@ -55,6 +55,142 @@ bool lake_mpmc_rotate(
     LAKE_UNREACHABLE;
 }
 
+s32 lake_mpmc_rotate_n(
+    lake_mpmc          *mpmc,
+    atomic_ssize       *in_or_out,
+    s32 const           stride,
+    s32 const           pos_delta,
+    s32 const           max_count,
+    lake_mpmc_result   *out_result)
+{
+    ssize const capacity = mpmc->buffer_mask + 1;
+    s32 const limit = (ssize)max_count < capacity ? max_count : (s32)capacity;
+    ssize pos = lake_atomic_read_explicit(in_or_out, lake_memory_model_relaxed);
+
+    *out_result = (lake_mpmc_result){ .node = nullptr, .pos = 0 };
+    if (limit <= 0) return 0;
+
+    for (;;) {
+        atomic_ssize *first = (atomic_ssize *)lake_elem(mpmc->buffer, stride, pos & mpmc->buffer_mask);
+        ssize seq = lake_atomic_read_explicit(first, lake_memory_model_acquire);
+        sptr diff = (sptr)seq - (sptr)(pos + pos_delta);
+
+        if (diff < 0) {
+            /* it's empty, or full for producers */
+            return 0;
+        } else if (diff > 0) {
+            pos = lake_atomic_read_explicit(in_or_out, lake_memory_model_relaxed);
+            continue;
+        }
+        /* the first slot is ready, count how many that follow it are ready too */
+        s32 count = 1;
+        while (count < limit) {
+            atomic_ssize *sequence = (atomic_ssize *)lake_elem(mpmc->buffer, stride, (pos + count) & mpmc->buffer_mask);
+            if (lake_atomic_read_explicit(sequence, lake_memory_model_acquire) != pos + count + pos_delta)
+                break;
+            count++;
+        }
+        /* a single position update reserves the whole run, slots can't be claimed
+         * by anyone else without moving the position past them first */
+        if (lake_atomic_compare_exchange_weak_explicit(in_or_out, &pos, pos + count,
+                lake_memory_model_relaxed, lake_memory_model_relaxed)) 
+        {
+            *out_result = (lake_mpmc_result){ .node = (void *)first, .pos = pos };
+            return count;
+        }
+    }
+    LAKE_UNREACHABLE;
+}
+
+/** Launched nodes are submitted in batches of this size. */
+#define DAGRAPH_SUBMIT_BATCH 32
+
+static FN_LAKE_WORK(dagraph_node_run, lake_dagraph_node *node)
+{
+    lake_dagraph *graph = node->graph;
+    lake_work_details batch[DAGRAPH_SUBMIT_BATCH];
+
+    while (node) {
+        node->work(node->payload);
+
+        /* the first dependent that is ready runs inline, the rest is submitted */
+        lake_dagraph_node *next = nullptr;
+        u32 batch_count = 0;
+
+        for (u32 i = 0; i < node->dependents_count; i++) {
+            lake_dagraph_id const id = node->dependents[i];
+            lake_dbg_assert(id < (lake_dagraph_id)graph->nodes.len, LAKE_INVALID_PARAMETERS, "Invalid dependent id %lu.", id);
+            lake_dagraph_node *dependent = lake_darray_at_t(&graph->nodes, lake_dagraph_node, id);
+
+            /* all work of the dependencies must be visible to the dependent */
+            if (lake_atomic_sub_explicit(&dependent->refcnt, 1, lake_memory_model_acq_rel) != 1)
+                continue;
+            if (!next) {
+                next = dependent;
+                continue;
+            }
+            batch[batch_count++] = (lake_work_details){
+                .procedure = (PFN_lake_work)dagraph_node_run,
+                .argument = dependent,
+                .name = "dagraph/node",
+            };
+            if (batch_count == DAGRAPH_SUBMIT_BATCH) {
+                lake_submit_work(batch_count, batch, nullptr);
+                batch_count = 0;
+            }
+        }
+        if (batch_count) lake_submit_work(batch_count, batch, nullptr);
+
+        /* the last node to finish releases the graph */
+        if (lake_atomic_sub_explicit(&graph->pending, 1, lake_memory_model_acq_rel) == 1)
+            lake_release_chain(graph->done);
+        node = next;
+    }
+}
+
+void lake_dagraph_run(lake_dagraph *graph)
+{
+    s32 const node_count = graph->nodes.len;
+    if (node_count == 0) return;
+
+    lake_dagraph_node *nodes = lake_darray_first_t(&graph->nodes, lake_dagraph_node);
+    for (s32 i = 0; i < node_count; i++) {
+        lake_atomic_write_explicit(&nodes[i].refcnt, (s32)nodes[i].dependencies_count, lake_memory_model_relaxed);
+        nodes[i].graph = graph;
+    }
+    lake_atomic_write_explicit(&graph->pending, node_count, lake_memory_model_relaxed);
+    graph->done = lake_acquire_chain();
+
+    /* submit the roots, the submit publishes the reset counters */
+    lake_work_details batch[DAGRAPH_SUBMIT_BATCH];
+    u32 batch_count = 0;
+    u32 root_count = 0;
+
+    for (s32 i = 0; i < node_count; i++) {
+        if (nodes[i].dependencies_count) continue;
+
+        root_count++;
+        batch[batch_count++] = (lake_work_details){
+            .procedure = (PFN_lake_work)dagraph_node_run,
+            .argument = &nodes[i],
+            .name = "dagraph/node",
+        };
+        if (batch_count == DAGRAPH_SUBMIT_BATCH) {
+            lake_submit_work(batch_count, batch, nullptr);
+            batch_count = 0;
+        }
+    }
+    if (batch_count) lake_submit_work(batch_count, batch, nullptr);
+
+    if (lake_unlikely(root_count == 0)) {
+        lake_dbg_assert(false, LAKE_INVALID_PARAMETERS, "The graph has no root nodes, it must contain a cycle.");
+        lake_release_chain(graph->done);
+    }
+
+    lake_yield(graph->done);
+    graph->done = 0;
+}
+
 char lake_strbuf_slopbuf[] = {'\0'};
 
 void lake_strbuf_appendstrn(
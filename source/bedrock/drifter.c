@@ -92,8 +92,10 @@ void _lake_drift_scratch(s32 depth)
             f->logger.tail_cursor = nullptr;
             f->logger.buf = (lake_strbuf){0};
         }
-        for (struct region *page = cursor->tail->next; page != nullptr; page = page->next)
-            if (page->alloc) release_heap_bitmap(g_bedrock->bitmap, page->v, page->alloc);
+        for (struct region *page = cursor->tail->next, *next; page != nullptr; page = next) {
+            next = page->next;
+            if (page->alloc) retire_heap_bitmap(page->v, page->alloc);
+        }
         d->tail_page->next = nullptr;
 #ifndef LAKE_NDEBUG
     } else {
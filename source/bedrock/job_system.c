@@ -1,21 +1,49 @@
 #include "bedrock_impl.h"
+#include <lake/math/bits.h>
 
-u32 lake_worker_thread_index(void)
+/** Fibonacci hashing, thread IDs are often aligned addresses with low bits that never vary. */
+LAKE_FORCE_INLINE u32 hash_thread_id(sys_thread_id id)
+{ return (u32)(((u64)(uptr)id * 0x9e3779b97f4a7c15llu) >> 32); }
+
+void register_worker_thread(s32 thread_idx)
 {
-    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    u32 const mask = g_bedrock->thread_lookup_mask;
+    u32 h = hash_thread_id(g_bedrock->threads[thread_idx]) & mask;
 
+    while (g_bedrock->thread_lookup[h] != 0) 
+        h = (h + 1) & mask;
+    g_bedrock->thread_lookup[h] = thread_idx + 1;
+}
+
+s32 find_worker_thread_index(void)
+{
     sys_thread_id self;
-    /* TODO implement a hashmap lookup for the worker thread index */
 #if defined(LAKE_PLATFORM_UNIX)
     self = (sys_thread_id)pthread_self();
-    for (s32 i = 0; i < g_bedrock->thread_count; i++)
-        if (pthread_equal(g_bedrock->threads[i], self)) return i;
 #elif defined(LAKE_PLATFORM_WINDOWS)
     self = (sys_thread_id)GetCurrentThreadId();
-    for (s32 i = 0; i < g_bedrock->thread_count; i++)
-        if (self == g_bedrock->threads[i]) return i;
 #endif /* LAKE_PLATFORM_UNIX */
-    return 0;
+    u32 const mask = g_bedrock->thread_lookup_mask;
+
+    /* the table is never full, so probing always ends at an empty slot */
+    for (u32 h = hash_thread_id(self) & mask;; h = (h + 1) & mask) {
+        s32 const slot = g_bedrock->thread_lookup[h];
+        if (slot == 0) return -1;
+#if defined(LAKE_PLATFORM_UNIX)
+        if (pthread_equal(g_bedrock->threads[slot - 1], self)) return slot - 1;
+#elif defined(LAKE_PLATFORM_WINDOWS)
+        if (self == g_bedrock->threads[slot - 1]) return slot - 1;
+#endif /* LAKE_PLATFORM_UNIX */
+    }
+    LAKE_UNREACHABLE;
+}
+
+u32 lake_worker_thread_index(void)
+{
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+
+    s32 const index = find_worker_thread_index();
+    return index >= 0 ? (u32)index : 0;
 }
 
 char const *lake_fiber_name(void)
@@ -24,91 +52,761 @@ char const *lake_fiber_name(void)
     return g_bedrock->fibers[tls->fiber_in_use].work.details.name;
 }
 
-/* XXX a lot of false sharing around index 0 is expected, there probably should be a better
- * way to acquire a free fiber than this primitive method - but it works so i don't care now */
-extern usize get_free_fiber(void)
+void *lake_fls_get(u32 slot)
+{
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    lake_dbg_assert(slot < LAKE_FLS_SLOT_COUNT, LAKE_ERROR_OUT_OF_RANGE, "FLS slot %u.", slot);
+
+    struct tls *tls = get_thread_local_storage();
+    return g_bedrock->fibers[tls->fiber_in_use].fls[slot];
+}
+
+void lake_fls_set(u32 slot, void *value)
 {
-    for (s32 i = 0; i < g_bedrock->fiber_count; i++) {
-        /* double lock helps CPUs that have a weak memory model, ARM should 
-         * go 2x to 3x faster using double lock, if it is the bottleneck */
-        usize fiber_idx = lake_atomic_read_explicit(&g_bedrock->free[i], lake_memory_model_relaxed);
-        if (fiber_idx == FIBER_INVALID) continue;
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    lake_dbg_assert(slot < LAKE_FLS_SLOT_COUNT, LAKE_ERROR_OUT_OF_RANGE, "FLS slot %u.", slot);
+
+    struct tls *tls = get_thread_local_storage();
+    g_bedrock->fibers[tls->fiber_in_use].fls[slot] = value;
+}
+
+/** Only the owner writes to it's counters, so a plain load and store will do, it's cheaper 
+ *  than a locked read-modify-write. Readers may see a stale value, but never a torn one. */
+LAKE_FORCE_INLINE void stats_add(atomic_u64 *counter, u64 n)
+{ lake_atomic_write_explicit(counter, lake_atomic_read_explicit(counter, lake_memory_model_relaxed) + n, lake_memory_model_relaxed); }
+
+LAKE_FORCE_INLINE void stats_max(atomic_u64 *counter, u64 value)
+{ if (value > lake_atomic_read_explicit(counter, lake_memory_model_relaxed)) lake_atomic_write_explicit(counter, value, lake_memory_model_relaxed); }
 
-        fiber_idx = lake_atomic_read_explicit(&g_bedrock->free[i], lake_memory_model_acquire);
-        if (fiber_idx == FIBER_INVALID) continue;
+u32 lake_worker_stats_snapshot(u32 capacity, lake_worker_stats *out_stats)
+{
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
 
-        usize expected = fiber_idx;
-        if (lake_atomic_compare_exchange_weak_explicit(&g_bedrock->free[i], &expected, 
-                FIBER_INVALID, lake_memory_model_release, lake_memory_model_relaxed))
+    u32 const thread_count = (u32)g_bedrock->thread_count;
+    for (u32 i = 0; i < lake_min(capacity, thread_count); i++) {
+        struct worker_stats const *stats = &g_bedrock->stats[i];
+        out_stats[i] = (lake_worker_stats){
+            .jobs_run = lake_atomic_read_explicit(&stats->jobs_run, lake_memory_model_relaxed),
+            .fiber_switches = lake_atomic_read_explicit(&stats->fiber_switches, lake_memory_model_relaxed),
+            .local_pops = lake_atomic_read_explicit(&stats->local_pops, lake_memory_model_relaxed),
+            .queue_dequeues = lake_atomic_read_explicit(&stats->queue_dequeues, lake_memory_model_relaxed),
+            .steals = lake_atomic_read_explicit(&stats->steals, lake_memory_model_relaxed),
+            .idle_ns = lake_atomic_read_explicit(&stats->idle_ns, lake_memory_model_relaxed),
+            .parks = lake_atomic_read_explicit(&stats->parks, lake_memory_model_relaxed),
+            .wait_polls = lake_atomic_read_explicit(&stats->wait_polls, lake_memory_model_relaxed),
+            .deque_depth_max = lake_atomic_read_explicit(&stats->deque_depth_max, lake_memory_model_relaxed),
+        };
+    }
+    return thread_count;
+}
+
+/** Pops from a Treiber stack. The head packs a generation tag in the upper 32 bits and an 
+ *  index in the lower 32 bits, links to the next index are found at `links + index * stride`. */
+static u32 free_list_pop(atomic_u64 *head_ptr, u8 *links, usize stride)
+{
+    u64 head = lake_atomic_read_explicit(head_ptr, lake_memory_model_acquire);
+
+    for (;;) {
+        u32 const idx = (u32)head;
+        if (idx == FREE_LIST_END) 
+            return FREE_LIST_END;
+
+        /* if the index was taken and given back in the meantime, the link may be stale, 
+         * but then the generation tag has changed too and the exchange will fail */
+        u32 const next = lake_atomic_read_explicit((atomic_u32 *)lake_elem(links, stride, idx), lake_memory_model_relaxed);
+        u64 const desired = (((head >> 32) + 1llu) << 32) | next;
+
+        if (lake_atomic_compare_exchange_weak_explicit(head_ptr, &head, 
+                desired, lake_memory_model_acq_rel, lake_memory_model_acquire))
         {
-            return fiber_idx;
+            return idx;
         }
     }
-    return FIBER_INVALID;
+    LAKE_UNREACHABLE;
 }
 
-static void update_free_and_waiting(struct tls *tls)
+/** Pushes into a Treiber stack, see `free_list_pop()`. */
+static void free_list_push(atomic_u64 *head_ptr, u8 *links, usize stride, u32 idx)
 {
-    if (tls->fiber_old == (u32)FIBER_INVALID) return;
+    u64 head = lake_atomic_read_explicit(head_ptr, lake_memory_model_relaxed);
 
-    usize const fiber_idx = tls->fiber_old & tls_mask;
+    for (;;) {
+        lake_atomic_write_explicit((atomic_u32 *)lake_elem(links, stride, idx), (u32)head, lake_memory_model_relaxed);
+        u64 const desired = (((head >> 32) + 1llu) << 32) | idx;
 
-    /* a thread that added the fiber to the free list is the same as the one freeing it */
-    if (tls->fiber_old & tls_to_free)
-        lake_atomic_write_explicit(&g_bedrock->free[fiber_idx], fiber_idx, lake_memory_model_relaxed);
+        if (lake_atomic_compare_exchange_weak_explicit(head_ptr, &head,
+                desired, lake_memory_model_release, lake_memory_model_relaxed))
+        {
+            return;
+        }
+    }
+}
 
-    /* wait threshold needs to be thread synced, so a CPU fence is welcome */
-    if (tls->fiber_old & tls_to_wait)
-        lake_atomic_write_explicit(&g_bedrock->waiting[fiber_idx], fiber_idx, lake_memory_model_release);
+extern usize get_free_fiber(lake_fiber_stack stack_class)
+{
+    lake_dbg_assert(stack_class >= 0 && stack_class < lake_fiber_stack_count, LAKE_INVALID_PARAMETERS, "Fiber stack class %d.", stack_class);
+    u32 fiber_idx = free_list_pop(&g_bedrock->free_head[stack_class], (u8 *)g_bedrock->free, sizeof(atomic_u32));
+    /* a larger stack will do too, it's better than waiting for a fiber to be freed */
+    for (s32 c = 0; fiber_idx == FREE_LIST_END && c < lake_fiber_stack_count; c++) {
+        if (c == stack_class || g_bedrock->stack_size[c] < g_bedrock->stack_size[stack_class]) continue;
+        fiber_idx = free_list_pop(&g_bedrock->free_head[c], (u8 *)g_bedrock->free, sizeof(atomic_u32));
+    }
+    return fiber_idx != FREE_LIST_END ? fiber_idx : FIBER_INVALID;
+}
 
-    tls->fiber_old = (u32)FIBER_INVALID;
+extern void put_free_fiber(usize fiber_idx)
+{
+    lake_fiber_stack const stack_class = g_bedrock->fibers[fiber_idx].stack_class;
+    free_list_push(&g_bedrock->free_head[stack_class], (u8 *)g_bedrock->free, sizeof(atomic_u32), (u32)fiber_idx);
 }
 
-static LAKE_NORETURN void LAKECALL the_work(sptr raw_tls);
+/** Resolves a chain handle, expired handles are asserted. */
+static struct chain *chain_from_handle(lake_work_chain handle)
+{
+    u32 const chain_idx = (u32)handle - 1u;
+    lake_dbg_assert(chain_idx < (u32)g_bedrock->chain_count, LAKE_INVALID_PARAMETERS, "Not a valid work chain.");
+
+    struct chain *chain = &g_bedrock->chains[chain_idx];
+    lake_dbg_assert(lake_atomic_read_explicit(&chain->generation, lake_memory_model_relaxed) == (u32)(handle >> 32), 
+            LAKE_ERROR_OUT_OF_DATE, "The work chain has expired.");
+    return chain;
+}
 
-static usize acquire_next_fiber(void)
+/** Returns a chain to the pool, handles to it will be expired from now on. */
+static void put_free_chain(struct chain *chain)
 {
-    usize fiber_idx = FIBER_INVALID;
+    u32 generation = lake_atomic_read_explicit(&chain->generation, lake_memory_model_relaxed) + 1u;
+    /* zero is reserved, so a valid handle is never the same as a null chain */
+    if (generation == 0u) generation = 1u;
+    lake_atomic_write_explicit(&chain->generation, generation, lake_memory_model_relaxed);
+
+    free_list_push(&g_bedrock->chain_head, (u8 *)&g_bedrock->chains[0].next, 
+            sizeof(struct chain), (u32)(chain - g_bedrock->chains));
+}
+
+/** Only the owner of the deque may push work. If there is not enough space for all 
+ *  of the work, only the part that fits is pushed. Returns the count of pushed work. */
+static u32 work_deque_push_n(
+    struct work_deque       *deque,
+    u32                      work_count,
+    lake_work_details const *work,
+    struct chain            *chain)
+{
+    ssize const b = lake_atomic_read_explicit(&deque->bottom, lake_memory_model_relaxed);
+    ssize const t = lake_atomic_read_explicit(&deque->top, lake_memory_model_acquire);
+    ssize const space = deque->buffer_mask + 1 - (b - t);
+    u32 const count = (u32)lake_min((ssize)work_count, space);
+
+    for (u32 i = 0; i < count; i++) {
+        struct work *slot = &deque->buffer[(b + i) & deque->buffer_mask];
+        slot->details = work[i];
+        slot->chain = chain;
+    }
+    /* publish the work for thieves */
+    lake_atomic_thread_fence(lake_memory_model_release);
+    lake_atomic_write_explicit(&deque->bottom, b + count, lake_memory_model_relaxed);
+    return count;
+}
+
+/** Only the owner of the deque may pop work, it takes the most recently pushed work. */
+static bool work_deque_pop(struct work_deque *deque, struct work *out_work)
+{
+    /* top only ever grows, so if the deque looks empty to the owner, it is empty */
+    if (lake_atomic_read_explicit(&deque->bottom, lake_memory_model_relaxed) <=
+        lake_atomic_read_explicit(&deque->top, lake_memory_model_relaxed)) return false;
+
+    ssize const b = lake_atomic_read_explicit(&deque->bottom, lake_memory_model_relaxed) - 1;
+    lake_atomic_write_explicit(&deque->bottom, b, lake_memory_model_relaxed);
+    lake_atomic_thread_fence(lake_memory_model_seq_cst);
+    ssize t = lake_atomic_read_explicit(&deque->top, lake_memory_model_relaxed);
+
+    if (t > b) {
+        /* it's empty */
+        lake_atomic_write_explicit(&deque->bottom, b + 1, lake_memory_model_relaxed);
+        return false;
+    }
+    *out_work = deque->buffer[b & deque->buffer_mask];
+    if (t == b) {
+        /* the last work left, we race against the thieves for it */
+        bool const won = lake_atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                lake_memory_model_seq_cst, lake_memory_model_relaxed);
+        lake_atomic_write_explicit(&deque->bottom, b + 1, lake_memory_model_relaxed);
+        return won;
+    }
+    return true;
+}
+
+/** Any worker may steal from the deque, it takes the least recently pushed work. */
+static bool work_deque_steal(struct work_deque *deque, struct work *out_work)
+{
+    /* a cheap peek, so scanning over empty deques of other priorities won't cost a fence */
+    if (lake_atomic_read_explicit(&deque->bottom, lake_memory_model_relaxed) <= 
+        lake_atomic_read_explicit(&deque->top, lake_memory_model_relaxed)) return false;
+
+    ssize t = lake_atomic_read_explicit(&deque->top, lake_memory_model_acquire);
+    lake_atomic_thread_fence(lake_memory_model_seq_cst);
+    ssize const b = lake_atomic_read_explicit(&deque->bottom, lake_memory_model_acquire);
+
+    if (t >= b) return false;
+
+    /* the copy may be torn if we lose the race, but then it's discarded anyway */
+    *out_work = deque->buffer[t & deque->buffer_mask];
+    return lake_atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+            lake_memory_model_seq_cst, lake_memory_model_relaxed);
+}
+
+/** Called only when the work queue is full or for pinned work, the lock is not on the fast path. */
+static void work_overflow_push(struct work_overflow *overflow, struct work const *work, u32 count)
+{
+    lake_spinlock_acquire(&overflow->lock);
+    while (count > 0) {
+        struct work_overflow_segment *segment = overflow->tail;
+        if (segment == nullptr || segment->tail == WORK_OVERFLOW_SEGMENT_SIZE) {
+            struct work_overflow_segment *grow = __lake_malloc_t(struct work_overflow_segment);
+            lake_san_assert(grow != nullptr, LAKE_ERROR_OUT_OF_HOST_MEMORY, "Failed to grow the work overflow.");
+            grow->next = nullptr;
+            grow->head = grow->tail = 0;
+            if (segment) segment->next = grow;
+            else overflow->head = grow;
+            overflow->tail = segment = grow;
+        }
+        u32 const n = lake_min(count, WORK_OVERFLOW_SEGMENT_SIZE - segment->tail);
+        lake_memcpy(&segment->work[segment->tail], work, sizeof(struct work) * n);
+        segment->tail += n;
+        work += n;
+        count -= n;
+        lake_atomic_add_explicit(&overflow->count, n, lake_memory_model_relaxed);
+    }
+    lake_spinlock_release(&overflow->lock);
+}
+
+static bool work_overflow_pop(struct work_overflow *overflow, struct work *out_work)
+{
+    struct work_overflow_segment *drained = nullptr;
+    bool found = false;
+
+    if (lake_likely(lake_atomic_read_explicit(&overflow->count, lake_memory_model_relaxed) == 0))
+        return false;
+
+    lake_spinlock_acquire(&overflow->lock);
+    struct work_overflow_segment *segment = overflow->head;
+    if (segment && segment->head < segment->tail) {
+        *out_work = segment->work[segment->head++];
+        lake_atomic_sub_explicit(&overflow->count, 1u, lake_memory_model_relaxed);
+        found = true;
+
+        if (segment->head == segment->tail) {
+            if (segment == overflow->tail) {
+                /* keep the last segment around for the next overflow */
+                segment->head = segment->tail = 0;
+            } else {
+                overflow->head = segment->next;
+                drained = segment;
+            }
+        }
+    }
+    lake_spinlock_release(&overflow->lock);
+
+    if (drained) __lake_free(drained);
+    return found;
+}
+
+static void release_overflow_segments(struct work_overflow *overflow)
+{
+    struct work_overflow_segment *segment = overflow->head;
+    while (segment) {
+        struct work_overflow_segment *next = segment->next;
+        __lake_free(segment);
+        segment = next;
+    }
+    overflow->head = overflow->tail = nullptr;
+}
+
+void release_work_overflow(void)
+{
+    for (s32 i = 0; i < lake_work_priority_count; i++)
+        release_overflow_segments(&g_bedrock->work_overflow[i]);
+    for (s32 i = 0; i < g_bedrock->thread_count; i++)
+        release_overflow_segments(&g_bedrock->tls[i].pinned);
+}
+
+/** Pushes work into the injection queue of it's priority, or into the overflow if it's full. */
+static void inject_work(s32 priority, struct work const *work, u32 work_count)
+{
+    u32 done = 0;
+    while (done < work_count) {
+        s32 const pushed = lake_mpmc_enqueue_bulk_t(&g_bedrock->work_queue[priority], work_queue_node, &work[done], (s32)(work_count - done));
+        if (lake_unlikely(pushed == 0)) {
+            /* the queue is full, don't wait for it to drain */
+            work_overflow_push(&g_bedrock->work_overflow[priority], &work[done], work_count - done);
+            return;
+        }
+        done += (u32)pushed;
+    }
+}
+
+/** Looks for work in the following order, for every priority class from the highest: the 
+ *  worker's own deque, the shared work queue with submissions from outside of the framework, 
+ *  and at last steals from other workers, from those sharing a cache domain first. Victims 
+ *  are picked at random, so the thieves won't all crowd around the same deque. Background 
+ *  work is taken only when nothing else was found. Work handed off by the last fiber goes first. */
+static bool acquire_work(struct tls *tls, struct work *out_work)
+{
+    s32 const thread_idx = (s32)(tls - g_bedrock->tls);
+    s32 const thread_count = g_bedrock->thread_count;
+
+    if (tls->has_handoff) {
+        *out_work = tls->handoff;
+        tls->has_handoff = false;
+        return true;
+    }
+    /* no one else can take work pinned to us */
+    if (work_overflow_pop(&tls->pinned, out_work)) {
+        stats_add(&tls->stats->queue_dequeues, 1);
+        return true;
+    }
+
+    u32 x = tls->steal_seed;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    tls->steal_seed = x;
+    s32 const first = (s32)(x % (u32)thread_count);
+    s32 const passes = g_bedrock->domain_count > 1 ? 2 : 1;
+
+    for (s32 priority = 0; priority < WORK_DEQUE_PRIORITY_COUNT; priority++) {
+        if (work_deque_pop(&g_bedrock->deques[thread_idx * WORK_DEQUE_PRIORITY_COUNT + priority], out_work)) {
+            stats_add(&tls->stats->local_pops, 1);
+            return true;
+        }
+        if (lake_mpmc_dequeue_t(&g_bedrock->work_queue[priority], work_queue_node, out_work) ||
+            work_overflow_pop(&g_bedrock->work_overflow[priority], out_work))
+        {
+            stats_add(&tls->stats->queue_dequeues, 1);
+            return true;
+        }
+
+        /* victims that share our cache domain go first, the work they hold is likely warm for us */
+        for (s32 pass = 0; pass < passes; pass++) {
+            for (s32 i = 0; i < thread_count; i++) {
+                s32 const victim = (first + i) % thread_count;
+                if (victim == thread_idx) continue;
+                if (passes > 1 && (g_bedrock->tls[victim].domain == tls->domain) != (pass == 0)) continue;
+                if (work_deque_steal(&g_bedrock->deques[victim * WORK_DEQUE_PRIORITY_COUNT + priority], out_work)) {
+                    stats_add(&tls->stats->steals, 1);
+                    return true;
+                }
+            }
+        }
+    }
+    /* we are idle */
+    if (lake_mpmc_dequeue_t(&g_bedrock->work_queue[lake_work_priority_background], work_queue_node, out_work) ||
+        work_overflow_pop(&g_bedrock->work_overflow[lake_work_priority_background], out_work))
+    {
+        stats_add(&tls->stats->queue_dequeues, 1);
+        return true;
+    }
+    return false;
+}
+
+/** Wakes the worker if it's parked, returns false if it wasn't or someone else woke it first. */
+static bool wake_parked_worker(struct tls *tls)
+{
+    if (!lake_atomic_read_explicit(&tls->parked, lake_memory_model_relaxed) ||
+        !lake_atomic_exchange_explicit(&tls->parked, 0u, lake_memory_model_acq_rel))
+        return false;
+    lake_atomic_add_explicit(&tls->park_epoch, 1u, lake_memory_model_release);
+    sys_futex_wake(&tls->park_epoch, 1);
+    return true;
+}
+
+/** Wakes up to `count` parked workers, after new work was made visible to them. */
+static void wake_workers(s32 count)
+{
+    /* pairs with the fence of a parking worker, either it sees our work or we see it parked */
+    lake_atomic_thread_fence(lake_memory_model_seq_cst);
+    s32 const parked = lake_atomic_read_explicit(&g_bedrock->parked_count, lake_memory_model_relaxed);
+    if (lake_likely(parked <= 0)) return;
+
+    s32 const thread_count = g_bedrock->thread_count;
+    u32 const start = lake_atomic_add_explicit(&g_bedrock->wake_cursor, 1u, lake_memory_model_relaxed);
+    count = lake_min(count, parked);
+    for (s32 i = 0; i < thread_count && count > 0; i++)
+        count -= wake_parked_worker(&g_bedrock->tls[(start + (u32)i) % (u32)thread_count]);
+}
+
+/** Called by a worker that stops parking, whether it was woken up or not. */
+static void unpark_worker(struct tls *tls)
+{
+    lake_atomic_write_explicit(&tls->parked, 0u, lake_memory_model_relaxed);
+    lake_atomic_sub_explicit(&g_bedrock->parked_count, 1, lake_memory_model_relaxed);
+}
+
+/** Wakes the one worker that can take pinned work, after the work was made visible to it. */
+static void wake_worker_on(s32 thread_idx)
+{
+    lake_atomic_thread_fence(lake_memory_model_seq_cst);
+    wake_parked_worker(&g_bedrock->tls[thread_idx]);
+}
+
+/** The ready queue holds twice as many slots as there are fibers. A consumer that claimed a slot 
+ *  keeps it until the sequence is written back, so without the slack a preempted worker could make
+ *  the queue look full. The loop is only a backstop, it waits for such a slot to be released. */
+static void push_ready_fiber(usize fiber_idx)
+{
+    s32 const pinned_to = g_bedrock->fibers[fiber_idx].pinned_to;
+    if (pinned_to >= 0) {
+        free_list_push(&g_bedrock->tls[pinned_to].pinned_ready, (u8 *)g_bedrock->free, sizeof(atomic_u32), (u32)fiber_idx);
+        wake_worker_on(pinned_to);
+        return;
+    }
+    ssize const ready = (ssize)fiber_idx;
+    while (!lake_mpmc_enqueue_t(&g_bedrock->ready_queue, lake_mpmc_node, &ready))
+        lake_cpu_relax();
+    wake_workers(1);
+}
+
+/** Submits work bound to a chain that is already acquired, or to no chain at all. */
+static void submit_work(
+    lake_work_priority       priority, 
+    u32                      work_count, 
+    lake_work_details const *work, 
+    struct chain            *chain)
+{
+    u32 i = 0;
+
+    /* a worker thread pushes into it's own deque, work that doesn't fit will spill */
+    s32 const thread_idx = priority < WORK_DEQUE_PRIORITY_COUNT ? find_worker_thread_index() : -1;
+    if (thread_idx >= 0) {
+        struct work_deque *deque = &g_bedrock->deques[thread_idx * WORK_DEQUE_PRIORITY_COUNT + priority];
+        i = work_deque_push_n(deque, work_count, work, chain);
+
+        ssize const depth = lake_atomic_read_explicit(&deque->bottom, lake_memory_model_relaxed) - 
+                            lake_atomic_read_explicit(&deque->top, lake_memory_model_relaxed);
+        stats_max(&g_bedrock->stats[thread_idx].deque_depth_max, (u64)lake_max(depth, 0));
+    }
+
+    /* spill the rest into the injection queue in batches, one reservation per batch */
+    while (i < work_count) {
+        struct work batch[WORK_SUBMIT_BATCH];
+        u32 const n = lake_min(work_count - i, (u32)WORK_SUBMIT_BATCH);
+        for (u32 j = 0; j < n; j++)
+            batch[j] = (struct work){ .details = work[i + j], .chain = chain };
+        inject_work(priority, batch, n);
+        i += n;
+    }
+    /* wake only as many parked workers as there is new work */
+    wake_workers((s32)work_count);
+}
+
+/** Submits the work of a continuation and gives it's chain back to the pool, no one else 
+ *  holds the chain at this point. */
+static void continue_chain(struct chain *chain, struct continuation *continuation)
+{
+    chain->continuation = nullptr;
+    put_free_chain(chain);
+    submit_work(continuation->priority, continuation->work_count, continuation->work, continuation->chain);
+    __lake_free(continuation);
+}
+
+/** Called exactly once, by the thread that dropped the chain to zero. */
+static void chain_dropped(struct chain *chain)
+{
+    usize const waiter = lake_atomic_exchange_explicit(&chain->waiter, CHAIN_DROPPED, lake_memory_model_acq_rel);
+
+    /* the continuation was published before the handshake, it's ours now */
+    if (waiter == CHAIN_CONTINUED) {
+        continue_chain(chain, chain->continuation);
+    /* the waiting fiber was already switched out, so it is safe to resume it now */
+    } else if (waiter != FIBER_INVALID) {
+        lake_dbg_assert(waiter != CHAIN_DROPPED, LAKE_PANIC, "The work chain was dropped twice.");
+        push_ready_fiber(waiter);
+    }
+}
+
+/** Links a timer into the slot of the wheel that matches it's deadline, the level is picked 
+ *  by how far ahead the deadline is. Deadlines too far ahead are clamped, the timer will be 
+ *  linked again when it's reached. Called with the lock held. */
+static void timer_link(struct timer_wheel *wheel, struct timer *timer)
+{
+    u64 const max_delta = (1llu << (TIMER_SLOT_BITS * TIMER_LEVEL_COUNT)) - 1;
+    u64 due = lake_max(timer->deadline, wheel->tick);
+    if (due - wheel->tick > max_delta) due = wheel->tick + max_delta;
+
+    u64 const delta = due - wheel->tick;
+    s32 level = 0;
+    while (level < TIMER_LEVEL_COUNT - 1 && delta >= (1llu << (TIMER_SLOT_BITS * (level + 1))))
+        level++;
+    u32 const slot = (u32)(due >> (TIMER_SLOT_BITS * level)) & (TIMER_SLOT_COUNT - 1);
+
+    timer->next = wheel->slots[level][slot];
+    wheel->slots[level][slot] = timer;
+    wheel->occupied[level] |= 1llu << slot;
+}
+
+/** Moves timers of a higher level slot down the wheel. Called with the lock held. */
+static void timer_cascade(struct timer_wheel *wheel, s32 level, u32 slot)
+{
+    struct timer *timer = wheel->slots[level][slot];
+    wheel->slots[level][slot] = nullptr;
+    wheel->occupied[level] &= ~(1llu << slot);
+
+    while (timer) {
+        struct timer *next = timer->next;
+        timer_link(wheel, timer);
+        timer = next;
+    }
+}
+
+/** Turns the wheel up to the given tick, returns a list of expired timers. Empty spans of 
+ *  the lowest level are skipped, so a wheel left alone for long catches up quickly. 
+ *  Called with the lock held. */
+static struct timer *timer_advance(struct timer_wheel *wheel, u64 now)
+{
+    struct timer *expired = nullptr;
+
+    while (wheel->tick <= now) {
+        u64 const t = wheel->tick;
+
+        /* entering a new span of a higher level, it's timers move down */
+        for (s32 level = 1; level < TIMER_LEVEL_COUNT; level++) {
+            u32 const shift = TIMER_SLOT_BITS * level;
+            if (t & ((1llu << shift) - 1)) break;
+            timer_cascade(wheel, level, (u32)(t >> shift) & (TIMER_SLOT_COUNT - 1));
+        }
+        u32 const slot = (u32)t & (TIMER_SLOT_COUNT - 1);
+        struct timer *timer = wheel->slots[0][slot];
+        wheel->slots[0][slot] = nullptr;
+        wheel->occupied[0] &= ~(1llu << slot);
+
+        while (timer) {
+            struct timer *next = timer->next;
+            if (timer->deadline <= t) {
+                timer->next = expired;
+                expired = timer;
+            } else {
+                /* it was clamped */
+                timer_link(wheel, timer);
+            }
+            timer = next;
+        }
+        wheel->tick = t + 1;
 
-    for (s32 i = 0; i < g_bedrock->fiber_count; i++) {
-        /* double lock helps CPUs that have a weak memory model, ARM should 
-         * go 2x to 3x faster using double lock, if it is the bottleneck */
-        usize fiber_waiting = lake_atomic_read_explicit(&g_bedrock->waiting[i], lake_memory_model_relaxed);
-        if (fiber_waiting == FIBER_INVALID) continue;
+        if ((wheel->occupied[0] | wheel->occupied[1] | wheel->occupied[2] | wheel->occupied[3]) == 0) {
+            wheel->tick = now + 1;
+        } else if (wheel->occupied[0] == 0) {
+            u64 const span = (wheel->tick + TIMER_SLOT_COUNT - 1) & ~(u64)(TIMER_SLOT_COUNT - 1);
+            wheel->tick = lake_min(span, now + 1);
+        }
+    }
+    return expired;
+}
+
+/** A lower bound of the next deadline in ticks, based on what slots are occupied. 
+ *  Called with the lock held. */
+static u64 timer_next_tick(struct timer_wheel const *wheel)
+{
+    u64 next = UINT64_MAX;
+
+    for (s32 level = 0; level < TIMER_LEVEL_COUNT; level++) {
+        u64 const occupied = wheel->occupied[level];
+        if (occupied == 0) continue;
+
+        /* the first span of this level that was not cascaded yet */
+        u32 const shift = TIMER_SLOT_BITS * level;
+        u64 const first = (wheel->tick + (1llu << shift) - 1) >> shift;
+        u32 const from = (u32)first & (TIMER_SLOT_COUNT - 1);
+        u64 const rotated = (occupied >> from) | (occupied << ((TIMER_SLOT_COUNT - from) & (TIMER_SLOT_COUNT - 1)));
+        next = lake_min(next, (first + (u64)lake_ctz64(rotated)) << shift);
+    }
+    return next;
+}
+
+/** Takes a timer from the pool, or allocates one if the pool is exhausted, so arming a timer 
+ *  never has to wait for another one to fire. Called with the lock held. */
+static struct timer *timer_acquire(struct timer_wheel *wheel)
+{
+    struct timer *timer = wheel->free;
+    if (lake_likely(timer != nullptr)) {
+        wheel->free = timer->next;
+        return timer;
+    }
+    timer = __lake_malloc_t(struct timer);
+    lake_san_assert(timer != nullptr, LAKE_ERROR_OUT_OF_HOST_MEMORY, "Failed to allocate a timer.");
+    return timer;
+}
+
+/** Called with the lock held. */
+static void timer_release(struct timer_wheel *wheel, struct timer *timer)
+{
+    if (timer >= wheel->pool && timer < &wheel->pool[wheel->pool_count]) {
+        timer->next = wheel->free;
+        wheel->free = timer;
+    } else {
+        __lake_free(timer);
+    }
+}
+
+/** Arms timers for a sleeping fiber, or for every delayed work of a submission. */
+static void timer_arm(u64 deadline_ns, u32 fiber_idx, lake_work_priority priority, 
+                      u32 work_count, lake_work_details const *work, struct chain *chain)
+{
+    struct timer_wheel *wheel = &g_bedrock->timers;
+    u64 const deadline = (deadline_ns + (1llu << TIMER_TICK_SHIFT) - 1) >> TIMER_TICK_SHIFT;
+    u32 const count = fiber_idx != (u32)FIBER_INVALID ? 1 : work_count;
+
+    lake_spinlock_acquire(&wheel->lock);
+    for (u32 i = 0; i < count; i++) {
+        struct timer *timer = timer_acquire(wheel);
+        timer->deadline = deadline;
+        timer->fiber_idx = fiber_idx;
+        timer->priority = priority;
+        if (work) timer->work = (struct work){ .details = work[i], .chain = chain };
+        timer_link(wheel, timer);
+    }
+    u64 const next_tick = timer_next_tick(wheel);
+    u64 const last_next_tick = lake_atomic_exchange_explicit(&wheel->next_tick, next_tick, lake_memory_model_relaxed);
+    lake_atomic_add_explicit(&wheel->count, count, lake_memory_model_relaxed);
+    lake_spinlock_release(&wheel->lock);
+
+    /* a parked worker may sleep past the new deadline, so it must set it's timeout again */
+    if (next_tick < last_next_tick) wake_workers(1);
+}
 
-        fiber_waiting = lake_atomic_read_explicit(&g_bedrock->waiting[i], lake_memory_model_acquire);
-        if (fiber_waiting == FIBER_INVALID) continue;
+/** Fires expired timers, called by workers looking for work. If another worker is already 
+ *  turning the wheel, this won't wait for it. */
+static void poll_timers(void)
+{
+    struct timer_wheel *wheel = &g_bedrock->timers;
+    if (lake_likely(lake_atomic_read_explicit(&wheel->count, lake_memory_model_relaxed) == 0))
+        return;
+
+    u64 const now = lake_time_ns() >> TIMER_TICK_SHIFT;
+    if (now < lake_atomic_read_explicit(&wheel->next_tick, lake_memory_model_relaxed)) 
+        return;
+    /* returns true if the lock was already taken */
+    if (lake_spinlock_try_acquire(&wheel->lock)) 
+        return;
 
-        struct fiber *fiber = &g_bedrock->fibers[fiber_waiting];
-        s32 finished = 1;
-        atomic_usize *counter = fiber->wait_counter;
+    struct timer *expired = timer_advance(wheel, now);
+    lake_atomic_write_explicit(&wheel->next_tick, timer_next_tick(wheel), lake_memory_model_relaxed);
+    lake_spinlock_release(&wheel->lock);
+    if (expired == nullptr) return;
 
-        if (counter) {
-            usize left = lake_atomic_read(counter);
-            finished = (!left);
+    u32 fired = 0;
+    for (struct timer *timer = expired; timer; timer = timer->next, fired++) {
+        if (timer->fiber_idx != (u32)FIBER_INVALID) {
+            push_ready_fiber(timer->fiber_idx);
+        } else {
+            inject_work(timer->priority, &timer->work, 1);
+            wake_workers(1);
         }
-        if (!finished) continue;
+    }
+    lake_spinlock_acquire(&wheel->lock);
+    while (expired) {
+        struct timer *next = expired->next;
+        timer_release(wheel, expired);
+        expired = next;
+    }
+    lake_spinlock_release(&wheel->lock);
+    lake_atomic_sub_explicit(&wheel->count, fired, lake_memory_model_relaxed);
+}
+
+/** How long may an idle worker park, 0 means until it's woken up. */
+static u64 park_timeout_ns(bool holds_waiter, u64 sleep_deadline)
+{
+    u64 timeout = holds_waiter ? PARK_TIMEOUT_NS : 0llu;
+    u64 deadline = sleep_deadline ? sleep_deadline : UINT64_MAX;
+
+    if (lake_atomic_read_explicit(&g_bedrock->timers.count, lake_memory_model_relaxed) > 0) {
+        u64 const next_tick = lake_atomic_read_explicit(&g_bedrock->timers.next_tick, lake_memory_model_relaxed);
+        if (next_tick != UINT64_MAX) deadline = lake_min(deadline, next_tick << TIMER_TICK_SHIFT);
+    }
+    if (deadline != UINT64_MAX) {
+        u64 const now = lake_time_ns();
+        u64 const until = deadline > now ? deadline - now : 1llu;
+        timeout = timeout ? lake_min(timeout, until) : until;
+    }
+    /* completions are reaped only by workers looking for work, so one can't sleep for long */
+    if (lake_atomic_read_explicit(&g_bedrock->io_inflight, lake_memory_model_relaxed) > 0)
+        timeout = timeout ? lake_min(timeout, PARK_TIMEOUT_NS) : PARK_TIMEOUT_NS;
+    return timeout;
+}
 
-        usize expected = fiber_waiting;
-        if (lake_atomic_compare_exchange_weak_explicit(&g_bedrock->waiting[i], &expected,
-                FIBER_INVALID, lake_memory_model_release, lake_memory_model_relaxed))
+/** Resumes fibers waiting for I/O requests that have completed. If another worker is already 
+ *  reaping completions, this won't wait for it. */
+static void poll_io(void)
+{
+    if (lake_likely(lake_atomic_read_explicit(&g_bedrock->io_inflight, lake_memory_model_relaxed) == 0))
+        return;
+
+    struct io_request *completed[IO_REAP_BATCH];
+    u32 const count = sys_io_reap(g_bedrock->io_ring, completed, IO_REAP_BATCH);
+    if (count == 0) return;
+
+    lake_atomic_sub_explicit(&g_bedrock->io_inflight, count, lake_memory_model_relaxed);
+    /* the request is gone once the chain is released, as the waiting fiber may resume */
+    for (u32 i = 0; i < count; i++)
+        lake_release_chain(completed[i]->chain);
+}
+
+static void update_free_and_waiting(struct tls *tls)
+{
+    if (tls->fiber_old == (u32)FIBER_INVALID) return;
+
+    usize const fiber_idx = tls->fiber_old & tls_mask;
+
+    /* a thread that added the fiber to the free list is the same as the one freeing it */
+    if (tls->fiber_old & tls_to_free)
+        put_free_fiber(fiber_idx);
+
+    /* the fiber is switched out now, we can register it as the waiter of it's chain */
+    if (tls->fiber_old & tls_to_wait) {
+        struct chain *chain = g_bedrock->fibers[fiber_idx].wait_chain;
+        usize expected = FIBER_INVALID;
+
+        /* if the chain was dropped in the meantime, no one will wake us, so resume right away */
+        if (!lake_atomic_compare_exchange_strong_explicit(&chain->waiter, &expected, fiber_idx,
+                lake_memory_model_acq_rel, lake_memory_model_acquire))
         {
-            fiber_idx = i;
-            break;
+            push_ready_fiber(fiber_idx);
         }
     }
-    if (fiber_idx == FIBER_INVALID) {
+    /* the fiber is switched out now, it can be resumed by the timer */
+    if (tls->fiber_old & tls_to_sleep) {
+        u64 const deadline_ns = g_bedrock->fibers[fiber_idx].sleep_deadline;
+        timer_arm(deadline_ns, (u32)fiber_idx, lake_work_priority_normal, 0, nullptr, nullptr);
+    }
+    tls->fiber_old = (u32)FIBER_INVALID;
+}
+
+static LAKE_NORETURN void LAKECALL the_work(sptr raw_tls);
+
+/** Sets `out_fresh` if the fiber starts new work, it's context was just made on this thread. */
+static usize acquire_next_fiber(struct tls *tls, bool *out_fresh)
+{
+    usize fiber_idx = FIBER_INVALID;
+    *out_fresh = false;
+
+    /* fibers that finished waiting are resumed first, they were woken by their chains */
+    u32 const pinned = free_list_pop(&tls->pinned_ready, (u8 *)g_bedrock->free, sizeof(atomic_u32));
+    ssize ready;
+    if (pinned != FREE_LIST_END) {
+        fiber_idx = pinned;
+    } else if (lake_mpmc_dequeue_t(&g_bedrock->ready_queue, lake_mpmc_node, &ready)) {
+        fiber_idx = (usize)ready;
+    } else {
         struct work data;
-        if (lake_mpmc_dequeue_t(&g_bedrock->work_queue, work_queue_node, &data)) {
+        if (acquire_work(tls, &data)) {
             while (fiber_idx == FIBER_INVALID)
-                fiber_idx = get_free_fiber();
+                fiber_idx = get_free_fiber(data.details.stack);
 
             struct fiber *fiber = &g_bedrock->fibers[fiber_idx];
             fiber->work = data;
+            stats_add(&tls->stats->jobs_run, 1);
 
             /* make_fcontext requires the top of the stack, as it grows downwards */
-            u8 *stack = &g_bedrock->stack[(fiber_idx + 1) * g_bedrock->stack_size];
-            make_fiber_context(&fiber->context, the_work, stack, g_bedrock->stack_size);
+            usize const stack_size = g_bedrock->stack_size[fiber->stack_class];
+            make_fiber_context(&fiber->context, the_work, fiber->stack + stack_size, stack_size);
+            *out_fresh = true;
         }
     }
     return fiber_idx;
@@ -117,30 +815,52 @@ static usize acquire_next_fiber(void)
 struct tls *fiber_search(struct tls *tls, fcontext *context)
 {
     struct fiber *old = nullptr;
-    atomic_usize *wait_counter = nullptr;
+    struct chain *wait_chain = nullptr;
+    u64 sleep_deadline = 0;
     
     if ((tls->fiber_old != (u32)FIBER_INVALID) && (tls->fiber_old & tls_to_wait)) {
         usize const fiber_idx = tls->fiber_old & tls_mask;
         old = &g_bedrock->fibers[fiber_idx];
-        wait_counter = old->wait_counter;
+        wait_chain = old->wait_chain;
+    } else if ((tls->fiber_old != (u32)FIBER_INVALID) && (tls->fiber_old & tls_to_sleep)) {
+        sleep_deadline = g_bedrock->fibers[tls->fiber_old & tls_mask].sleep_deadline;
     }
 
+    u32 spins = 0;
+    u32 epoch = 0;
+    bool parked = false;
+    /* the clock is read only once the first search came up empty */
+    u64 idle_start = 0;
+
     for (;;) {
-        usize fiber_idx = acquire_next_fiber();
+        poll_timers();
+        poll_io();
+        bool fresh;
+        usize fiber_idx = acquire_next_fiber(tls, &fresh);
 
         if (fiber_idx != FIBER_INVALID) {
             struct fiber *fiber = &g_bedrock->fibers[fiber_idx];
             tls->fiber_in_use = (u32)fiber_idx;
 
-            /* inherit information from the last fiber */
+            stats_add(&tls->stats->fiber_switches, 1);
+            if (idle_start) stats_add(&tls->stats->idle_ns, lake_time_ns() - idle_start);
+
+            if (parked) {
+                unpark_worker(tls);
+            } else if (spins) {
+                /* spinning paid off, we can afford to spin for longer */
+                tls->spin_limit = lake_min(tls->spin_limit << 1, PARK_SPIN_MAX);
+            }
+
+            /* Inherit information from the last fiber. The drifter and the log buffer are not 
+             * shared, as the waiting fiber may resume on another thread while this one runs. */
             if (old != nullptr) {
-                if (old->drifter.head) 
-                    fiber->drifter = old->drifter;
-                fiber->logger.depth = 1 + old->logger.depth;
+                if (fresh) fiber->logger.depth = 1 + old->logger.depth;
                 if (old->logger.should_flush)
                     flush_logger(&old->logger);
-                fiber->logger.buf = old->logger.buf;
             }
+            /* a new context has nothing to restore yet */
+            if (fresh) return (struct tls *)jump_fresh_fiber_context(tls, context, &fiber->context);
             return (struct tls *)jump_fiber_context(tls, context, &fiber->context);
         }
 
@@ -150,16 +870,50 @@ struct tls *fiber_search(struct tls *tls, fcontext *context)
          * a new context to swap to is found - there's no new jobs. The context swap code 
          * deadlocks looking for a new job to swap to, when no jobs may arrive. Meanwhile
          * the "to be swapped" context is waiting to be run, but cannot as it hasn't been 
-         * swapped out yet (in order to be picked up by the wait list). */
-        if (wait_counter) {
-            usize count = lake_atomic_read_explicit(wait_counter, lake_memory_model_relaxed);
+         * swapped out yet (in order to be registered as the waiter of it's chain). */
+        if (wait_chain) {
+            usize const waiter = lake_atomic_read_explicit(&wait_chain->waiter, lake_memory_model_acquire);
+            stats_add(&tls->stats->wait_polls, 1);
 
-            if (!count) {
+            if (waiter == CHAIN_DROPPED) {
+                if (parked) unpark_worker(tls);
+                if (idle_start) stats_add(&tls->stats->idle_ns, lake_time_ns() - idle_start);
                 /* variable `tls->fiber_in_use` still points to the "to waitlist" fiber */
                 tls->fiber_old = (u32)FIBER_INVALID;
                 return tls;
             }
         }
+        /* same as above, the sleeping fiber can't be armed until it's switched out */
+        if (sleep_deadline && lake_time_ns() >= sleep_deadline) {
+            if (parked) unpark_worker(tls);
+            if (idle_start) stats_add(&tls->stats->idle_ns, lake_time_ns() - idle_start);
+            tls->fiber_old = (u32)FIBER_INVALID;
+            return tls;
+        }
+
+        /* no work for now, spin for a while before parking the worker */
+        if (idle_start == 0) idle_start = lake_time_ns();
+        if (spins < tls->spin_limit) {
+            spins++;
+            lake_cpu_relax();
+            continue;
+        }
+        if (!parked) {
+            /* announce that we're parking and look for work one last time, any submit 
+             * that we miss from now on will see us parked and bump the epoch */
+            epoch = lake_atomic_read_explicit(&tls->park_epoch, lake_memory_model_acquire);
+            lake_atomic_write_explicit(&tls->parked, 1u, lake_memory_model_seq_cst);
+            lake_atomic_add_explicit(&g_bedrock->parked_count, 1, lake_memory_model_seq_cst);
+            lake_atomic_thread_fence(lake_memory_model_seq_cst);
+            parked = true;
+            continue;
+        }
+        stats_add(&tls->stats->parks, 1);
+        sys_futex_wait(&tls->park_epoch, epoch, park_timeout_ns(wait_chain != nullptr, sleep_deadline));
+        unpark_worker(tls);
+        tls->spin_limit = lake_max(tls->spin_limit >> 1, PARK_SPIN_MIN);
+        parked = false;
+        spins = 0;
     }
     LAKE_UNREACHABLE;
 }
@@ -194,14 +948,17 @@ static LAKE_NORETURN void LAKECALL the_work(sptr raw_tls)
     fiber->logger.should_flush = false;
 
     for (;;) { /* do the work */
+        lake_memset(fiber->fls, 0, sizeof(fiber->fls));
         fiber->work.details.procedure(fiber->work.details.argument);
 
         if (fiber->logger.should_flush) 
             flush_logger(&fiber->logger);
         /* release unnecessary resources */
         if (fiber->drifter.head != nullptr) {
-            for (struct region *page = fiber->drifter.tail_page->next; page != nullptr; page = page->next)
-                if (page->alloc) release_heap_bitmap(g_bedrock->bitmap, page->v, page->alloc);
+            for (struct region *page = fiber->drifter.tail_page->next, *next; page != nullptr; page = next) {
+                next = page->next;
+                if (page->alloc) retire_heap_bitmap(page->v, page->alloc);
+            }
             if (fiber->cursor.tail) {
                 fiber->drifter.tail_page = fiber->cursor.tail;
                 fiber->drifter.tail_page->offset = fiber->cursor.offset;
@@ -210,19 +967,34 @@ static LAKE_NORETURN void LAKECALL the_work(sptr raw_tls)
         }
 
         /* decrement the chain */
-        if (fiber->work.work_left) {
-            usize last = lake_atomic_sub(fiber->work.work_left, 1lu);
+        if (fiber->work.chain) {
+            usize last = lake_atomic_sub_explicit(&fiber->work.chain->counter, 1lu, lake_memory_model_acq_rel);
             lake_dbg_assert(last > 0, LAKE_PANIC, nullptr);
 
-            /* try to reuse the fiber */
-            if (last > 1 && lake_mpmc_dequeue_t(&g_bedrock->work_queue, work_queue_node, &fiber->work)) 
-                continue;
+            /* we dropped the chain, wake the waiting fiber */
+            if (last == 1)
+                chain_dropped(fiber->work.chain);
+
+            /* try to reuse the fiber, it could have migrated to another thread while yielding */
+            struct tls *tls = get_thread_local_storage();
+            if (last > 1 && acquire_work(tls, &tls->handoff)) {
+                /* work that needs a larger stack is handed off to a fiber of it's class */
+                if (g_bedrock->stack_size[fiber->stack_class] >= g_bedrock->stack_size[tls->handoff.details.stack]) {
+                    fiber->work = tls->handoff;
+                    stats_add(&tls->stats->jobs_run, 1);
+                    continue;
+                }
+                tls->has_handoff = true;
+            }
         }
         fiber->drifter.tail_cursor = fiber->cursor.prev;
         /* if we own the drifter, destroy it */
         if (fiber->drifter.tail_cursor == nullptr && fiber->drifter.head) {
-            struct region *page = fiber->drifter.head;
-            release_heap_bitmap(g_bedrock->bitmap, page->v, page->alloc);
+            /* the region lives in the block it describes, so it's read before the release */
+            for (struct region *page = fiber->drifter.head, *next; page != nullptr; page = next) {
+                next = page->next;
+                retire_heap_bitmap(page->v, page->alloc);
+            }
             fiber->drifter = (struct drifter){0};
         }
 
@@ -237,27 +1009,31 @@ static LAKE_NORETURN void LAKECALL the_work(sptr raw_tls)
     LAKE_UNREACHABLE;
 }
 
-lake_work_chain lake_acquire_chain_n(usize initial_value)
+lake_work_chain lake_acquire_chain_v(usize initial_value)
 {
     lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
-    for (;;) {
-        /* as with acquiring the fibers, this method of traversing through the locks 
-         * is primitive, it may be a point of optimization to revisit this later */
-        for (s32 i = 0; i < g_bedrock->fiber_count; i++) {
-            atomic_usize *lock = &g_bedrock->locks[i];
-
-            if (lake_atomic_read(lock) == FIBER_INVALID) {
-                usize expected = FIBER_INVALID;
-
-                if (lake_atomic_compare_exchange_weak_explicit(lock, &expected,
-                        initial_value, lake_memory_model_relaxed, lake_memory_model_relaxed))
-                {
-                    return (lake_work_chain)lock;
-                }
-            }
-        }
+
+    u32 chain_idx = free_list_pop(&g_bedrock->chain_head, (u8 *)&g_bedrock->chains[0].next, sizeof(struct chain));
+    /* every chain is in use, wait until one is given back to the pool */
+    while (chain_idx == FREE_LIST_END) {
+        lake_dbg_assert(false, LAKE_ERROR_OUT_OF_POOL_MEMORY, "The pool of work chains is exhausted.");
+        chain_idx = free_list_pop(&g_bedrock->chain_head, (u8 *)&g_bedrock->chains[0].next, sizeof(struct chain));
     }
-    LAKE_UNREACHABLE;
+    struct chain *chain = &g_bedrock->chains[chain_idx];
+
+    lake_atomic_write_explicit(&chain->counter, initial_value, lake_memory_model_relaxed);
+    /* a chain with no work is dropped from the start */
+    lake_atomic_write_explicit(&chain->waiter, initial_value ? FIBER_INVALID : CHAIN_DROPPED, lake_memory_model_release);
+
+    u32 const generation = lake_atomic_read_explicit(&chain->generation, lake_memory_model_relaxed);
+    return ((lake_work_chain)generation << 32) | (chain_idx + 1u);
+}
+
+void lake_release_chain(lake_work_chain handle)
+{
+    struct chain *chain = chain_from_handle(handle);
+    usize const last = lake_atomic_exchange_explicit(&chain->counter, 0lu, lake_memory_model_acq_rel);
+    if (last != 0lu) chain_dropped(chain);
 }
 
 void lake_submit_work(
@@ -265,43 +1041,343 @@ void lake_submit_work(
     lake_work_details const *work, 
     lake_work_chain         *out_chain)
 {
-    atomic_usize *to_use = nullptr;
+    lake_submit_work_priority(lake_work_priority_normal, work_count, work, out_chain);
+}
+
+void lake_submit_work_priority(
+    lake_work_priority       priority,
+    u32                      work_count, 
+    lake_work_details const *work, 
+    lake_work_chain         *out_chain)
+{
+    struct chain *to_use = nullptr;
     lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    lake_dbg_assert(priority >= 0 && priority < lake_work_priority_count, LAKE_INVALID_PARAMETERS, nullptr);
 
     if (out_chain) {
-        *out_chain = lake_acquire_chain_n(work_count);
-        to_use = (atomic_usize *)*out_chain;
+        *out_chain = lake_acquire_chain_v(work_count);
+        to_use = &g_bedrock->chains[(u32)*out_chain - 1u];
     }
+    submit_work(priority, work_count, work, to_use);
+}
 
-    for (u32 i = 0; i < work_count; i++) {
-        struct work submit = { .details = work[i], .work_left = to_use };
+void lake_submit_work_after(
+    lake_work_priority       priority,
+    lake_work_chain          after,
+    u32                      work_count, 
+    lake_work_details const *work, 
+    lake_work_chain         *out_chain)
+{
+    struct chain *to_use = nullptr;
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    lake_dbg_assert(priority >= 0 && priority < lake_work_priority_count, LAKE_INVALID_PARAMETERS, nullptr);
 
-        while (!lake_mpmc_enqueue_t(&g_bedrock->work_queue, work_queue_node, &submit)) {
-            lake_dbg_assert(false, LAKE_ERROR_OUT_OF_RANGE, 
-                "Failed to submit work into the work queue at: %u/%u.", i, work_count);
-        }
+    if (out_chain) {
+        *out_chain = lake_acquire_chain_v(work_count);
+        to_use = &g_bedrock->chains[(u32)*out_chain - 1u];
+    }
+    if (after == 0) {
+        submit_work(priority, work_count, work, to_use);
+        return;
+    }
+    struct chain *chain = chain_from_handle(after);
+
+    /* the chain was dropped already, no need to copy the work */
+    if (lake_atomic_read_explicit(&chain->waiter, lake_memory_model_acquire) == CHAIN_DROPPED) {
+        put_free_chain(chain);
+        submit_work(priority, work_count, work, to_use);
+        return;
+    }
+    struct continuation *continuation = (struct continuation *)
+        __lake_malloc(sizeof(struct continuation) + sizeof(lake_work_details) * work_count, alignof(struct continuation));
+    lake_san_assert(continuation != nullptr, LAKE_ERROR_OUT_OF_HOST_MEMORY, "Failed to allocate a continuation.");
+
+    continuation->priority = priority;
+    continuation->work_count = work_count;
+    continuation->chain = to_use;
+    if (work_count) lake_memcpy(continuation->work, work, sizeof(lake_work_details) * work_count);
+    chain->continuation = continuation;
+
+    /* if the chain was dropped in the meantime, the work is submitted from here */
+    usize expected = FIBER_INVALID;
+    if (!lake_atomic_compare_exchange_strong_explicit(&chain->waiter, &expected, CHAIN_CONTINUED,
+            lake_memory_model_acq_rel, lake_memory_model_acquire))
+    {
+        lake_dbg_assert(expected == CHAIN_DROPPED, LAKE_INVALID_PARAMETERS, "The work chain already has a waiter.");
+        continue_chain(chain, continuation);
     }
 }
 
-void lake_yield(lake_work_chain chain)
+void lake_yield(lake_work_chain handle)
 {
-    usize wait_value = 0;
+    bool should_wait = false;
+    struct chain *chain = nullptr;
     lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
 
-    if (chain) {
-        wait_value = lake_atomic_read(chain);
-        lake_dbg_assert(wait_value != FIBER_INVALID, LAKE_ERROR_OUT_OF_DATE, "The work chain has expired.");
+    if (handle) {
+        chain = chain_from_handle(handle);
+        /* the counter may be zero while the dropping thread still holds the chain, 
+         * so completion is decided by the waiter handshake instead of the counter */
+        should_wait = lake_atomic_read_explicit(&chain->waiter, lake_memory_model_acquire) != CHAIN_DROPPED;
     }
-    if (wait_value) {
+    if (should_wait) {
         struct tls *tls = get_thread_local_storage();
         struct fiber *old = &g_bedrock->fibers[tls->fiber_in_use];
         if (old->logger.should_flush)
             flush_logger(&old->logger);
 
-        old->wait_counter = chain;
+        old->wait_chain = chain;
         tls->fiber_old = tls->fiber_in_use | tls_to_wait;
         tls = fiber_search(tls, &old->context);
         update_free_and_waiting(tls);
     }
-    if (chain) lake_atomic_write_explicit(chain, FIBER_INVALID, lake_memory_model_release);
+    if (chain) put_free_chain(chain);
+}
+
+void lake_submit_work_on(
+    u32                      worker_idx,
+    u32                      work_count, 
+    lake_work_details const *work, 
+    lake_work_chain         *out_chain)
+{
+    struct chain *to_use = nullptr;
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    lake_dbg_assert(worker_idx < (u32)g_bedrock->thread_count, LAKE_INVALID_PARAMETERS, "Worker index %u.", worker_idx);
+
+    if (out_chain) {
+        *out_chain = lake_acquire_chain_v(work_count);
+        to_use = &g_bedrock->chains[(u32)*out_chain - 1u];
+    }
+    struct tls *tls = &g_bedrock->tls[worker_idx];
+    for (u32 i = 0; i < work_count;) {
+        struct work batch[WORK_SUBMIT_BATCH];
+        u32 const n = lake_min(work_count - i, (u32)WORK_SUBMIT_BATCH);
+        for (u32 j = 0; j < n; j++)
+            batch[j] = (struct work){ .details = work[i + j], .chain = to_use };
+        work_overflow_push(&tls->pinned, batch, n);
+        i += n;
+    }
+    if (work_count) wake_worker_on((s32)worker_idx);
+}
+
+void lake_yield_pinned(lake_work_chain handle)
+{
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    s32 const thread_idx = find_worker_thread_index();
+    lake_dbg_assert(thread_idx >= 0, LAKE_INVALID_PARAMETERS, "Only a fiber of a worker thread can be pinned.");
+
+    struct tls *tls = get_thread_local_storage();
+    struct fiber *fiber = &g_bedrock->fibers[tls->fiber_in_use];
+    fiber->pinned_to = thread_idx;
+    lake_yield(handle);
+    fiber->pinned_to = -1;
+}
+
+void lake_submit_work_delayed(
+    lake_work_priority       priority,
+    u64                      deadline_ns,
+    u32                      work_count,
+    lake_work_details const *work,
+    lake_work_chain         *out_chain)
+{
+    struct chain *to_use = nullptr;
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    lake_dbg_assert(priority >= 0 && priority < lake_work_priority_count, LAKE_INVALID_PARAMETERS, nullptr);
+
+    if (lake_time_ns() >= deadline_ns) {
+        lake_submit_work_priority(priority, work_count, work, out_chain);
+        return;
+    }
+    if (out_chain) {
+        *out_chain = lake_acquire_chain_v(work_count);
+        to_use = &g_bedrock->chains[(u32)*out_chain - 1u];
+    }
+    if (work_count) timer_arm(deadline_ns, (u32)FIBER_INVALID, priority, work_count, work, to_use);
+}
+
+void lake_yield_until(u64 deadline_ns)
+{
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    if (lake_time_ns() >= deadline_ns) return;
+
+    struct tls *tls = get_thread_local_storage();
+    struct fiber *old = &g_bedrock->fibers[tls->fiber_in_use];
+    if (old->logger.should_flush)
+        flush_logger(&old->logger);
+
+    old->sleep_deadline = deadline_ns;
+    tls->fiber_old = tls->fiber_in_use | tls_to_sleep;
+    tls = fiber_search(tls, &old->context);
+    update_free_and_waiting(tls);
+}
+
+/** Queues the request into the I/O ring and yields until it completes. If the ring is not 
+ *  available or full, the request runs synchronously on this worker instead. */
+static s64 fs_async(s32 fd, void *buf, usize size, u64 offset, bool write)
+{
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    struct io_request request = { .chain = 0, .result = 0 };
+
+    if (g_bedrock->io_ring) {
+        u32 const inflight = lake_atomic_add_explicit(&g_bedrock->io_inflight, 1u, lake_memory_model_relaxed);
+        if (inflight < g_bedrock->io_request_count) {
+            /* the chain is bound before the submit, the completion can be reaped right away */
+            request.chain = lake_acquire_chain();
+            if (sys_io_submit(g_bedrock->io_ring, &request, fd, buf, size, offset, write)) {
+                lake_yield(request.chain);
+                return request.result;
+            }
+            /* give the chain back */
+            lake_release_chain(request.chain);
+            lake_yield(request.chain);
+        }
+        lake_atomic_sub_explicit(&g_bedrock->io_inflight, 1u, lake_memory_model_relaxed);
+    }
+    return sys_io_sync(fd, buf, size, offset, write);
+}
+
+s64 lake_fs_read_async(s32 fd, void *dst, usize size, u64 offset)
+{
+    return fs_async(fd, dst, size, offset, false);
+}
+
+s64 lake_fs_write_async(s32 fd, void const *src, usize size, u64 offset)
+{
+    return fs_async(fd, (void *)src, size, offset, true);
+}
+
+/** A range of a parallel loop, if value is not nullptr it's a reduction. Partial results of 
+ *  the splits are kept inline, so no memory has to be allocated while the loop runs. */
+struct parallel_task {
+    LAKE_ALIGNMENT(16) u8       partial[LAKE_PARALLEL_REDUCE_MAX_VALUE_SIZE];
+    usize                       begin;
+    usize                       end;
+    usize                       grain;
+    PFN_lake_parallel_for       fn;
+    PFN_lake_parallel_reduce    reduce;
+    PFN_lake_parallel_join      join;
+    void const                 *identity;
+    usize                       value_size;
+    void                       *value;
+    void                       *userdata;
+};
+
+static FN_LAKE_WORK(parallel_task_run, struct parallel_task const *task)
+{
+    usize begin = task->begin;
+    usize end = task->end;
+
+    /* every split halves the range, count them first so only as many are allocated */
+    u32 split_depth = 0;
+    for (usize size = end - begin; size > task->grain; size >>= 1)
+        split_depth++;
+
+    /* the splits would take too much of a small fiber stack, they live in a drift scope */
+    struct parallel_task *splits = nullptr;
+    lake_work_details *work = nullptr;
+    u32 split_count = 0;
+    if (split_depth) {
+        lake_drift_push();
+        splits = lake_drift_allocate_n(struct parallel_task, split_depth);
+        work = lake_drift_allocate_n(lake_work_details, split_depth);
+    }
+
+    while ((end - begin) > task->grain) {
+        usize const mid = begin + ((end - begin) >> 1);
+        struct parallel_task *split = &splits[split_count];
+
+        *split = *task;
+        split->begin = mid;
+        split->end = end;
+        if (task->value) {
+            split->value = split->partial;
+            lake_memcpy(split->value, task->identity, task->value_size);
+        }
+        work[split_count++] = (lake_work_details){
+            .procedure = (PFN_lake_work)parallel_task_run,
+            .argument = split,
+            .name = "bedrock/parallel",
+        };
+        end = mid;
+    }
+    lake_work_chain chain = 0;
+    if (split_count) lake_submit_work(split_count, work, &chain);
+
+    /* the last chunk runs inline */
+    if (task->value) {
+        task->reduce(begin, end, task->value, task->userdata);
+    } else {
+        task->fn(begin, end, task->userdata);
+    }
+    lake_yield(chain);
+
+    if (task->value) {
+        /* the last split covers the range right after our own chunk */
+        for (u32 i = split_count; i-- > 0;)
+            task->join(task->value, splits[i].value, task->userdata);
+    }
+    if (split_depth) lake_drift_pop();
+}
+
+/** Aim for a few chunks per worker, so the load can balance itself out by stealing. */
+static usize parallel_grain(usize begin, usize end, usize grain)
+{
+    if (grain) return grain;
+    usize const chunk_count = (usize)g_bedrock->thread_count * 8lu;
+    return lake_max((end - begin) / chunk_count, 1lu);
+}
+
+void lake_parallel_for(
+    usize                    begin,
+    usize                    end,
+    usize                    grain,
+    PFN_lake_parallel_for    fn,
+    void                    *userdata)
+{
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    if (begin >= end) return;
+
+    struct parallel_task task = {
+        .begin = begin,
+        .end = end,
+        .grain = parallel_grain(begin, end, grain),
+        .fn = fn,
+        .userdata = userdata,
+    };
+    parallel_task_run(&task);
+}
+
+void lake_parallel_reduce(
+    usize                    begin,
+    usize                    end,
+    usize                    grain,
+    PFN_lake_parallel_reduce fn,
+    PFN_lake_parallel_join   join,
+    usize                    value_size,
+    void const              *identity,
+    void                    *result,
+    void                    *userdata)
+{
+    lake_san_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    lake_memcpy(result, identity, value_size);
+    if (begin >= end) return;
+
+    /* there is no room for the partial results, the range is reduced without splitting it */
+    if (lake_unlikely(value_size > LAKE_PARALLEL_REDUCE_MAX_VALUE_SIZE)) {
+        fn(begin, end, result, userdata);
+        return;
+    }
+
+    struct parallel_task task = {
+        .begin = begin,
+        .end = end,
+        .grain = parallel_grain(begin, end, grain),
+        .reduce = fn,
+        .join = join,
+        .identity = identity,
+        .value_size = value_size,
+        .value = result,
+        .userdata = userdata,
+    };
+    parallel_task_run(&task);
 }
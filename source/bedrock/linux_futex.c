@@ -0,0 +1,23 @@
+#include "bedrock_impl.h"
+
+#ifdef LAKE_PLATFORM_LINUX
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+void sys_futex_wait(atomic_u32 *address, u32 expected, u64 timeout_ns)
+{
+    struct timespec ts = {
+        .tv_sec = (time_t)(timeout_ns / 1000000000llu),
+        .tv_nsec = (long)(timeout_ns % 1000000000llu),
+    };
+    /* spurious wakeups, timeouts and a changed value are all fine, the caller will look again */
+    syscall(SYS_futex, (u32 *)address, FUTEX_WAIT_PRIVATE, expected, timeout_ns ? &ts : nullptr, nullptr, 0);
+}
+
+void sys_futex_wake(atomic_u32 *address, s32 count)
+{
+    syscall(SYS_futex, (u32 *)address, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+#endif /* LAKE_PLATFORM_LINUX */
@@ -0,0 +1,181 @@
+#include "bedrock_impl.h"
+
+#ifdef LAKE_PLATFORM_LINUX
+#include <errno.h>
+#include <string.h> /* strerror */
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/** The rings are shared with the kernel. We own the tail of the submission queue and the
+ *  head of the completion queue, the kernel owns the other two. */
+struct io_ring {
+    s32                         fd;
+    u32                         sq_entries;
+    lake_spinlock               sq_lock;
+    lake_spinlock               cq_lock;
+
+    atomic_u32                 *sq_head;
+    atomic_u32                 *sq_tail;
+    u32                        *sq_array;
+    u32                         sq_mask;
+    struct io_uring_sqe        *sqes;
+
+    atomic_u32                 *cq_head;
+    atomic_u32                 *cq_tail;
+    u32                         cq_mask;
+    struct io_uring_cqe        *cqes;
+
+    void                       *sq_ring;
+    usize                       sq_ring_bytes;
+    void                       *cq_ring;
+    usize                       cq_ring_bytes;
+    usize                       sqes_bytes;
+};
+
+static s32 io_uring_enter(s32 fd, u32 to_submit)
+{
+    s32 ret;
+    do {
+        ret = (s32)syscall(__NR_io_uring_enter, fd, to_submit, 0u, 0u, nullptr, 0lu);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+struct io_ring *sys_io_ring_create(u32 entries)
+{
+    struct io_uring_params params = {0};
+    s32 const fd = (s32)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) return nullptr;
+
+    /* IORING_OP_READ and IORING_OP_WRITE came with the same kernel as this feature */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(fd);
+        return nullptr;
+    }
+    struct io_ring *ring = __lake_malloc_t(struct io_ring);
+    if (ring == nullptr) {
+        close(fd);
+        return nullptr;
+    }
+    *ring = (struct io_ring){
+        .fd = fd,
+        .sq_entries = params.sq_entries,
+        .sq_lock = lake_spinlock_init,
+        .cq_lock = lake_spinlock_init,
+        .sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(u32),
+        .cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe),
+        .sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe),
+    };
+    bool const single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        ring->sq_ring_bytes = ring->cq_ring_bytes = lake_max(ring->sq_ring_bytes, ring->cq_ring_bytes);
+
+    ring->sq_ring = mmap(nullptr, ring->sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = single_mmap ? ring->sq_ring
+        : mmap(nullptr, ring->cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    ring->sqes = (struct io_uring_sqe *)
+        mmap(nullptr, ring->sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || (void *)ring->sqes == MAP_FAILED) {
+        lake_error("Failed to map the io_uring queues: %s.", strerror(errno));
+        sys_io_ring_destroy(ring);
+        return nullptr;
+    }
+    u8 *sq = (u8 *)ring->sq_ring;
+    ring->sq_head  = (atomic_u32 *)&sq[params.sq_off.head];
+    ring->sq_tail  = (atomic_u32 *)&sq[params.sq_off.tail];
+    ring->sq_array = (u32 *)&sq[params.sq_off.array];
+    ring->sq_mask  = *(u32 *)&sq[params.sq_off.ring_mask];
+
+    u8 *cq = (u8 *)ring->cq_ring;
+    ring->cq_head  = (atomic_u32 *)&cq[params.cq_off.head];
+    ring->cq_tail  = (atomic_u32 *)&cq[params.cq_off.tail];
+    ring->cq_mask  = *(u32 *)&cq[params.cq_off.ring_mask];
+    ring->cqes     = (struct io_uring_cqe *)&cq[params.cq_off.cqes];
+    return ring;
+}
+
+void sys_io_ring_destroy(struct io_ring *ring)
+{
+    if (ring == nullptr) return;
+
+    if (ring->sqes && (void *)ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_bytes);
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_bytes);
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED)
+        munmap(ring->sq_ring, ring->sq_ring_bytes);
+    close(ring->fd);
+    __lake_free(ring);
+}
+
+bool sys_io_submit(
+    struct io_ring     *ring,
+    struct io_request  *request,
+    s32                 fd,
+    void               *buf,
+    usize               size,
+    u64                 offset,
+    bool                write)
+{
+    lake_spinlock_acquire(&ring->sq_lock);
+    u32 const tail = lake_atomic_read_explicit(ring->sq_tail, lake_memory_model_relaxed);
+    u32 const head = lake_atomic_read_explicit(ring->sq_head, lake_memory_model_acquire);
+
+    if (lake_unlikely(tail - head >= ring->sq_entries)) {
+        lake_spinlock_release(&ring->sq_lock);
+        return false;
+    }
+    u32 const idx = tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    lake_memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (u64)(uptr)buf;
+    /* a larger transfer is cut short, the same as a partial read or write */
+    sqe->len = (u32)lake_min(size, (usize)UINT32_MAX);
+    sqe->off = offset;
+    sqe->user_data = (u64)(uptr)request;
+    ring->sq_array[idx] = idx;
+
+    /* the entry must be visible to the kernel before the tail moves */
+    lake_atomic_write_explicit(ring->sq_tail, tail + 1, lake_memory_model_release);
+    lake_spinlock_release(&ring->sq_lock);
+
+    /* if this fails, the entry stays queued and goes with the next call that succeeds */
+    io_uring_enter(ring->fd, 1);
+    return true;
+}
+
+u32 sys_io_reap(struct io_ring *ring, struct io_request **out_requests, u32 max_count)
+{
+    /* returns true if the lock was already taken, another worker is reaping */
+    if (lake_spinlock_try_acquire(&ring->cq_lock))
+        return 0;
+
+    u32 head = lake_atomic_read_explicit(ring->cq_head, lake_memory_model_relaxed);
+    u32 const tail = lake_atomic_read_explicit(ring->cq_tail, lake_memory_model_acquire);
+    u32 count = 0;
+
+    while (head != tail && count < max_count) {
+        struct io_uring_cqe const *cqe = &ring->cqes[head & ring->cq_mask];
+        struct io_request *request = (struct io_request *)(uptr)cqe->user_data;
+        request->result = cqe->res;
+        out_requests[count++] = request;
+        head++;
+    }
+    /* the kernel may reuse the entries once the head moves */
+    lake_atomic_write_explicit(ring->cq_head, head, lake_memory_model_release);
+
+    /* entries left behind by a failed submit */
+    u32 const sq_tail = lake_atomic_read_explicit(ring->sq_tail, lake_memory_model_acquire);
+    u32 const sq_head = lake_atomic_read_explicit(ring->sq_head, lake_memory_model_acquire);
+    lake_spinlock_release(&ring->cq_lock);
+
+    if (lake_unlikely(count == 0 && sq_tail != sq_head))
+        io_uring_enter(ring->fd, sq_tail - sq_head);
+    return count;
+}
+#endif /* LAKE_PLATFORM_LINUX */
@@ -78,6 +78,51 @@ void sys_cpuinfo(s32 *out_threads, s32 *out_cores, s32 *out_packages)
     if (out_packages) *out_packages = packages;
 }
 
+/** Reads the leading integer of a small sysfs file, or returns the fallback value. 
+ *  For CPU lists like "0-7,16-23" this is the lowest CPU in the list. */
+static s32 read_sysfs_s32(char const *path, s32 fallback)
+{
+    char buf[64];
+    s32 fd = open(path, O_RDONLY);
+    if (fd == -1) return fallback;
+
+    ssize len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0 || buf[0] < '0' || buf[0] > '9') return fallback;
+    buf[len] = '\0';
+    return atoi(buf);
+}
+
+s32 sys_cpu_topology(struct cpu_topology *out, s32 max_count)
+{
+    s32 const cpu_count = (s32)sysconf(_SC_NPROCESSORS_CONF);
+    if (cpu_count <= 0) return 0;
+    if (out == nullptr) return cpu_count;
+
+    char path[128];
+    s32 count = 0;
+
+    for (s32 cpu = 0; cpu < cpu_count && count < max_count; cpu++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        s32 const core = read_sysfs_s32(path, -1);
+        if (core < 0) continue; /* offline */
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        s32 const package = read_sysfs_s32(path, 0);
+        /* index3 is the L3 on x86 and most arm64 parts, without it the package is the domain */
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index3/shared_cpu_list", cpu);
+        s32 const domain = read_sysfs_s32(path, -1 - package);
+        /* big.LITTLE systems report relative core performance, up to 1024 */
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+        s32 const capacity = read_sysfs_s32(path, 1024);
+
+        out[count++] = (struct cpu_topology){ 
+            .cpu = cpu, .core = core, .package = package, .domain = domain, .capacity = capacity };
+    }
+    cpu_topology_order(out, count);
+    return count;
+}
+
 void sys_meminfo(usize *out_total_ram, usize *out_page_size)
 {
     ssize page, bytes;
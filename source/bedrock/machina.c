@@ -1,19 +1,206 @@
 #include "bedrock_impl.h"
+#include <lake/math/bits.h>
+
+/** Tells an allocation from the OS apart from memory that was not given out by machina, 
+ *  e.g. a slab object freed after the framework returned and it's slabs were unmapped. */
+#define MACHINA_OS_MAGIC 0x616e6968636d6c6bllu
 
 struct malloc_allocation_header {
     void *outer;    /**< Unaligned pointer returned by malloc(). */
     usize size;     /**< Original size from the requested allocation. */
+    u64   magic;    /**< Always MACHINA_OS_MAGIC. */
 };
 
-void *__lake_malloc(
-    usize size, 
-    usize align)
+/** Sizes of slab objects, a step of 16 bytes up to 64, and then two steps per power of two. */
+static u16 const g_class_size[MACHINA_CLASS_COUNT] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048 };
+
+/** The header of a slab, at the start of it's memory. Free objects are linked through their 
+ *  first bytes. The owner frees into it's magazine and refills from the local free list, 
+ *  other threads push into the remote list. The owner takes the whole remote list at once, 
+ *  so the pushes can't suffer from ABA. */
+struct slab {
+    /** Objects given back by the owner, no other thread touches this list. */
+    void                       *free;
+    /** The next slab of the owner with objects left, valid while `partial` is set. */
+    struct slab                *partial_next;
+    /** The next slab in a pending stack, see `struct machina_cache`. */
+    struct slab                *pending_next;
+    /** Objects freed by other threads. */
+    atomic_uptr                 remote;
+    /** Offset of the objects that were never handed out. */
+    u32                         bump;
+    u32                         size;
+    s32                         owner;
+    s32                         size_class;
+    bool                        partial;
+};
+lake_static_assert(sizeof(struct slab) <= MACHINA_SLAB_HEADER_SIZE, "The slab header must fit before the first object.");
+
+/** Picks the smallest class that fits the size, and is a multiple of the alignment. 
+ *  Every class from 256 bytes up is a multiple of 256, so up to MACHINA_MAX_ALIGN a class is found. */
+LAKE_FORCE_INLINE s32 size_class(usize size, usize align)
 {
-    lake_dbg_assert(lake_is_pow2(align), LAKE_INVALID_PARAMETERS, nullptr);
+    s32 c;
+    if (size <= 64) {
+        c = (s32)((size + 15) >> 4) - 1;
+    } else {
+        /* the size is within (2^lg, 2^(lg + 1)], the bit below the top decides the half */
+        s32 const lg = 31 - lake_clz((u32)size - 1);
+        c = 4 + (lg - 6) * 2 + (s32)(((size - 1) >> (lg - 1)) & 1);
+    }
+    while (g_class_size[c] & (align - 1)) c++;
+    return c;
+}
 
-    if (size == 0)
+/** Slabs are aligned to their size within the bedrock mapping, as are tagged heap blocks. */
+LAKE_FORCE_INLINE bool is_slab_object(void const *ptr)
+{ return g_bedrock != nullptr && (uptr)ptr - (uptr)g_bedrock < g_bedrock->budget; }
+
+LAKE_FORCE_INLINE struct slab *slab_from_object(void const *ptr)
+{
+    uptr const offset = ((uptr)ptr - (uptr)g_bedrock) & ~(MACHINA_SLAB_SIZE - 1);
+    return (struct slab *)((u8 *)g_bedrock + offset);
+}
+
+LAKE_FORCE_INLINE void push_partial(struct machina_cache *cache, struct slab *slab)
+{
+    if (slab->partial) return;
+    slab->partial = true;
+    slab->partial_next = cache->partial[slab->size_class];
+    cache->partial[slab->size_class] = slab;
+}
+
+/** Carves a new slab from the worker's block, a new block is acquired when it runs out. 
+ *  The blocks are kept until the framework is torn down, slabs are never given back. */
+static struct slab *carve_slab(struct machina_cache *cache, s32 owner, s32 c)
+{
+    if (cache->block == 0 || cache->block_carved + MACHINA_SLAB_SIZE > LAKE_TAGGED_HEAP_BLOCK_SIZE) {
+        usize const block = acquire_blocks(LAKE_TAGGED_HEAP_BLOCK_SIZE);
+        if (lake_unlikely(block == 0)) return nullptr;
+        cache->block = block;
+        cache->block_carved = 0;
+    }
+    struct slab *slab = (struct slab *)((u8 *)g_bedrock + cache->block + cache->block_carved);
+    cache->block_carved += MACHINA_SLAB_SIZE;
+
+    slab->free = nullptr;
+    slab->partial_next = slab->pending_next = nullptr;
+    lake_atomic_init(&slab->remote, 0);
+    slab->bump = (u32)MACHINA_SLAB_HEADER_SIZE;
+    slab->size = g_class_size[c];
+    slab->owner = owner;
+    slab->size_class = c;
+    slab->partial = false;
+    push_partial(cache, slab);
+    return slab;
+}
+
+/** Refills an empty magazine up to half of it's capacity. Slabs with objects left go first, 
+ *  then those that got objects freed remotely. A slab is carved only if both came up empty. 
+ *  A refill never looks at slabs that have nothing to give, so it's cost stays bounded. */
+static bool refill_magazine(struct machina_cache *cache, s32 owner, s32 c)
+{
+    struct magazine *mag = &cache->magazines[c];
+    u32 const want = MACHINA_MAGAZINE_CAPACITY / 2;
+
+    for (;;) {
+        struct slab *slab = cache->partial[c];
+        while (slab && mag->count < want) {
+            while (slab->free && mag->count < want) {
+                void *object = slab->free;
+                slab->free = *(void **)object;
+                mag->objects[mag->count++] = object;
+            }
+            while (mag->count < want && slab->bump + slab->size <= MACHINA_SLAB_SIZE) {
+                mag->objects[mag->count++] = (u8 *)slab + slab->bump;
+                slab->bump += slab->size;
+            }
+            if (slab->free == nullptr && slab->bump + slab->size > MACHINA_SLAB_SIZE) {
+                /* it's empty, it will be back once an object is freed */
+                slab->partial = false;
+                cache->partial[c] = slab = slab->partial_next;
+            }
+        }
+        if (mag->count > 0) return true;
+
+        /* the pending slabs go back to the partial list with their remote objects */
+        uptr pending = lake_atomic_exchange_explicit(&cache->pending[c], 0, lake_memory_model_acquire);
+        if (pending == 0) break;
+        while (pending) {
+            slab = (struct slab *)pending;
+            /* once the remote list is taken, the slab may be pushed again, so read the link first */
+            pending = (uptr)slab->pending_next;
+            void *remote = (void *)lake_atomic_exchange_explicit(&slab->remote, 0, lake_memory_model_acquire);
+
+            while (remote) {
+                void *next = *(void **)remote;
+                *(void **)remote = slab->free;
+                slab->free = remote;
+                remote = next;
+            }
+            push_partial(cache, slab);
+        }
+    }
+    struct slab *slab = carve_slab(cache, owner, c);
+    if (slab == nullptr) return false;
+    return refill_magazine(cache, owner, c);
+}
+
+/** A worker allocates from it's magazine, with no atomics on the hot path. */
+static void *slab_malloc(s32 thread_idx, s32 c)
+{
+    struct machina_cache *cache = &g_bedrock->machina[thread_idx];
+    struct magazine *mag = &cache->magazines[c];
+
+    if (lake_unlikely(mag->count == 0 && !refill_magazine(cache, thread_idx, c)))
         return nullptr;
+    return mag->objects[--mag->count];
+}
 
+static void slab_free(void *ptr)
+{
+    struct slab *slab = slab_from_object(ptr);
+
+    /* the object goes back to a thread that doesn't own it, the owner will collect it on refill */
+    if (find_worker_thread_index() != slab->owner) {
+        uptr head = lake_atomic_read_explicit(&slab->remote, lake_memory_model_relaxed);
+        do {
+            *(uptr *)ptr = head;
+        } while (!lake_atomic_compare_exchange_weak_explicit(&slab->remote, &head, (uptr)ptr,
+                lake_memory_model_release, lake_memory_model_relaxed));
+
+        /* the first remote object since the owner took the list, the slab must be announced */
+        if (head == 0) {
+            atomic_uptr *pending = &g_bedrock->machina[slab->owner].pending[slab->size_class];
+            uptr top = lake_atomic_read_explicit(pending, lake_memory_model_relaxed);
+            do {
+                slab->pending_next = (struct slab *)top;
+            } while (!lake_atomic_compare_exchange_weak_explicit(pending, &top, (uptr)slab,
+                    lake_memory_model_release, lake_memory_model_relaxed));
+        }
+        return;
+    }
+    struct machina_cache *cache = &g_bedrock->machina[slab->owner];
+    struct magazine *mag = &cache->magazines[slab->size_class];
+    if (lake_unlikely(mag->count == MACHINA_MAGAZINE_CAPACITY)) {
+        /* the older half goes back to the slabs, recently freed objects are more likely warm */
+        u32 const half = MACHINA_MAGAZINE_CAPACITY / 2;
+        for (u32 i = 0; i < half; i++) {
+            void *object = mag->objects[i];
+            struct slab *owner = slab_from_object(object);
+            *(void **)object = owner->free;
+            owner->free = object;
+            push_partial(cache, owner);
+        }
+        lake_memmove(&mag->objects[0], &mag->objects[half], sizeof(void *) * half);
+        mag->count = half;
+    }
+    mag->objects[mag->count++] = ptr;
+}
+
+/** Allocates from the OS, with a header in front of the aligned memory. */
+static void *os_malloc(usize size, usize align)
+{
     void *outer = malloc(align + sizeof(struct malloc_allocation_header) + size);
     if (!outer)
         return nullptr;
@@ -24,12 +211,46 @@ void *__lake_malloc(
     struct malloc_allocation_header header;
     header.outer = outer;
     header.size = size;
+    header.magic = MACHINA_OS_MAGIC;
 
     /* store the header just before inner */
     lake_memcpy((void *)(inner - sizeof(struct malloc_allocation_header)), &header, sizeof(struct malloc_allocation_header));
     return (void *)inner;
 }
 
+/** Reads the header of an allocation from the OS. Memory that carries no header would be 
+ *  given to free(), so it's a fatal error even when asserts are compiled out. */
+static struct malloc_allocation_header os_header(void const *ptr)
+{
+    struct malloc_allocation_header header;
+    lake_memcpy(&header, (u8 const *)ptr - sizeof(struct malloc_allocation_header), sizeof(struct malloc_allocation_header));
+    if (lake_unlikely(header.magic != MACHINA_OS_MAGIC)) {
+        lake_fatal("Memory at %p was not allocated by machina, or it was a slab object released after the framework returned.", ptr);
+        lake_abort(LAKE_INVALID_PARAMETERS);
+    }
+    return header;
+}
+
+void *__lake_malloc(
+    usize size, 
+    usize align)
+{
+    lake_dbg_assert(lake_is_pow2(align), LAKE_INVALID_PARAMETERS, nullptr);
+
+    if (size == 0)
+        return nullptr;
+
+    /* only worker threads own slabs, other threads and large allocations go to the OS */
+    if (size <= MACHINA_MAX_SIZE && align <= MACHINA_MAX_ALIGN && g_bedrock != nullptr) {
+        s32 const thread_idx = find_worker_thread_index();
+        if (thread_idx >= 0) {
+            void *object = slab_malloc(thread_idx, size_class(size, align));
+            if (lake_likely(object != nullptr)) return object;
+        }
+    }
+    return os_malloc(size, align);
+}
+
 void *__lake_realloc(
     void *ptr, 
     usize size, 
@@ -45,11 +266,23 @@ void *__lake_realloc(
         return nullptr;
     }
 
+    /* a slab object is moved only if it has outgrown it's size class */
+    if (is_slab_object(ptr)) {
+        struct slab const *slab = slab_from_object(ptr);
+        if (size <= slab->size && ((uptr)ptr & (align - 1)) == 0)
+            return ptr;
+
+        void *grown = __lake_malloc(size, align);
+        if (!grown)
+            return nullptr;
+        lake_memcpy(grown, ptr, lake_min(size, (usize)slab->size));
+        slab_free(ptr);
+        return grown;
+    }
     uptr inner = (uptr)ptr;
 
     /* header of the original allocation */
-    struct malloc_allocation_header header;
-    lake_memcpy(&header, (void *)(inner - sizeof(struct malloc_allocation_header)), sizeof(struct malloc_allocation_header));
+    struct malloc_allocation_header header = os_header(ptr);
 
     /* If we can be certain that realloc will return a correctly-aligned pointer (which typically 
      * means alignment <= alignof(double)) then it's most efficiently to simply use that.
@@ -86,7 +319,7 @@ void *__lake_realloc(
         return (void *)new_inner;
     } else {
         /* get a totally new aligned buffer */
-        void *new_inner = __lake_malloc(size, align);
+        void *new_inner = os_malloc(size, align);
         if (!new_inner)
             return nullptr;
         
@@ -94,7 +327,7 @@ void *__lake_realloc(
         lake_memcpy(new_inner, (void *)inner, lake_min(size, header.size));
 
         /* release the original buffer */
-        __lake_free(header.outer);
+        free(header.outer);
         return new_inner;
     }
 }
@@ -103,9 +336,10 @@ void __lake_free(void *ptr)
 {
     if (ptr == nullptr) return;
 
-    uptr inner = (uptr)ptr;
-    struct malloc_allocation_header header;
-
-    lake_memcpy(&header, (void *)(inner - sizeof(struct malloc_allocation_header)), sizeof(struct malloc_allocation_header));
+    if (is_slab_object(ptr)) {
+        slab_free(ptr);
+        return;
+    }
+    struct malloc_allocation_header const header = os_header(ptr);
     free(header.outer);
 }
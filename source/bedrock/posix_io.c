@@ -0,0 +1,50 @@
+#include "bedrock_impl.h"
+
+#if defined(LAKE_PLATFORM_UNIX)
+#include <errno.h>
+#include <unistd.h>
+
+s64 sys_io_sync(s32 fd, void *buf, usize size, u64 offset, bool write)
+{
+    ssize ret;
+    do {
+        ret = write ? pwrite(fd, buf, size, (off_t)offset) : pread(fd, buf, size, (off_t)offset);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? -(s64)errno : (s64)ret;
+}
+
+#if !defined(LAKE_PLATFORM_LINUX)
+/* only Linux has an I/O ring, elsewhere every request runs synchronously on the calling worker */
+struct io_ring *sys_io_ring_create(u32 entries)
+{
+    (void)entries;
+    return nullptr;
+}
+
+void sys_io_ring_destroy(struct io_ring *ring)
+{
+    (void)ring;
+}
+
+bool sys_io_submit(
+    struct io_ring     *ring,
+    struct io_request  *request,
+    s32                 fd,
+    void               *buf,
+    usize               size,
+    u64                 offset,
+    bool                write)
+{
+    (void)ring; (void)request; (void)fd; (void)buf; (void)size; (void)offset; (void)write;
+    return false;
+}
+
+u32 sys_io_reap(struct io_ring *ring, struct io_request **out_requests, u32 max_count)
+{
+    (void)ring;
+    (void)out_requests;
+    (void)max_count;
+    return 0;
+}
+#endif /* LAKE_PLATFORM_LINUX */
+#endif /* LAKE_PLATFORM_UNIX */
@@ -44,6 +44,16 @@ void sys_munmap(void *mapped, usize size_page_aligned)
     if (res != 0) { lake_log_from_critical_path(2, "Failed munmap with status %d.", res); }
 }
 
+bool sys_guard_pages(void *mapped, usize offset, usize size)
+{
+    if (mprotect((void *)((sptr)mapped + offset), size, PROT_NONE) != 0) {
+        lake_log_from_critical_path(3, "Failed to protect guard pages: %lu bytes at %lu mapped offset: %s.", 
+                size, offset, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
 bool sys_madvise(void *mapped, usize offset, usize size, bool commit_or_release)
 {
     void       *raw_map = (void *)((sptr)mapped + offset);
@@ -78,4 +88,15 @@ bool sys_madvise(void *mapped, usize offset, usize size, bool commit_or_release)
     }
     return success;
 }
+
+bool sys_mpurge(void *mapped, usize offset, usize size)
+{
+    /* anonymous private pages are dropped, they are faulted in as zeroes on the next touch */
+    if (madvise((void *)((sptr)mapped + offset), size, MADV_DONTNEED) != 0) {
+        lake_log_from_critical_path(3, "Failed purge of physical memory: %lu bytes (%lu MB) at %lu mapped offset (%lu MB): %s.",
+                size, size >> 20, offset, offset >> 20, strerror(errno));
+        return false;
+    }
+    return true;
+}
 #endif /* LAKE_PLATFORM_UNIX */
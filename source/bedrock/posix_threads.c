@@ -8,6 +8,7 @@
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/cdefs.h>
+#include <time.h>
 
 void sys_thread_create(sys_thread_id *out_thread, void *(*procedure)(void *), void *argument)
 {
@@ -49,20 +50,84 @@ void sys_thread_join(sys_thread_id thread)
     }
 }
 
-void sys_thread_affinity(u32 thread_count, sys_thread_id const *threads, u32 cpu_count, u32 begin_cpu_idx)
+void sys_thread_affinity(u32 thread_count, sys_thread_id const *threads, struct cpu_topology const *topology, u32 topology_count)
 {
-    u32 i = 0;
-    u32 j = begin_cpu_idx;
-    while (i < thread_count && j < cpu_count) {
+    for (u32 i = 0; i < thread_count && topology_count > 0; i++) {
+        s32 const cpu = topology[i % topology_count].cpu;
         cpu_set_t set;
         CPU_ZERO(&set);
-        CPU_SET(j, &set);
+        CPU_SET(cpu, &set);
 
         if (pthread_setaffinity_np((pthread_t)threads[i], sizeof(cpu_set_t), &set) != 0) {
-            lake_error("pthread_setaffinity_np failed for CPU %u and thread %u.", j, i);
+            lake_error("pthread_setaffinity_np failed for CPU %d and thread %u.", cpu, i);
             return;
         }
-        i++; j++;
     }
 }
+
+#if !defined(LAKE_PLATFORM_LINUX)
+/* Without futexes a word is waited on through a condition variable. Words hash into a few 
+ * buckets, a bucket may be shared, so a wake wakes every waiter of the bucket. Those that 
+ * were not meant to be woken see their word unchanged and look for work again anyway. */
+#define FUTEX_BUCKET_COUNT 64
+
+struct futex_bucket {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+};
+static struct futex_bucket g_futex_buckets[FUTEX_BUCKET_COUNT];
+static pthread_once_t g_futex_once = PTHREAD_ONCE_INIT;
+
+static void futex_buckets_init(void)
+{
+    for (u32 i = 0; i < FUTEX_BUCKET_COUNT; i++) {
+        pthread_mutex_init(&g_futex_buckets[i].mutex, nullptr);
+        pthread_cond_init(&g_futex_buckets[i].cond, nullptr);
+    }
+}
+
+static struct futex_bucket *futex_bucket(atomic_u32 const *address)
+{
+    pthread_once(&g_futex_once, futex_buckets_init);
+    return &g_futex_buckets[((u64)(uptr)address * 0x9e3779b97f4a7c15llu) >> 58];
+}
+
+void sys_futex_wait(atomic_u32 *address, u32 expected, u64 timeout_ns)
+{
+    struct futex_bucket *bucket = futex_bucket(address);
+
+    pthread_mutex_lock(&bucket->mutex);
+    /* the waker changes the word before it takes the lock, so the wake can't be missed */
+    if (lake_atomic_read_explicit(address, lake_memory_model_acquire) == expected) {
+        if (timeout_ns) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            u64 const ns = (u64)ts.tv_nsec + timeout_ns;
+            ts.tv_sec += (time_t)(ns / 1000000000llu);
+            ts.tv_nsec = (long)(ns % 1000000000llu);
+            pthread_cond_timedwait(&bucket->cond, &bucket->mutex, &ts);
+        } else {
+            pthread_cond_wait(&bucket->cond, &bucket->mutex);
+        }
+    }
+    pthread_mutex_unlock(&bucket->mutex);
+}
+
+void sys_futex_wake(atomic_u32 *address, s32 count)
+{
+    (void)count;
+    struct futex_bucket *bucket = futex_bucket(address);
+
+    pthread_mutex_lock(&bucket->mutex);
+    pthread_cond_broadcast(&bucket->cond);
+    pthread_mutex_unlock(&bucket->mutex);
+}
+
+s32 sys_cpu_topology(struct cpu_topology *out, s32 max_count)
+{
+    (void)out;
+    (void)max_count;
+    return 0;
+}
+#endif /* LAKE_PLATFORM_LINUX */
 #endif /* LAKE_PLATFORM_UNIX */
@@ -27,7 +27,7 @@ static void check_monotonic(void)
     if (mach_timebase_info(&mach_base_info) == 0)
         g_has_monotonic = 1;
 #endif /* LAKE_HAS_CLOCK_GETTIME */
-    g_checked_monotonic = 0;
+    g_checked_monotonic = 1;
 }
 
 u64 lake_rtc_counter(void)
@@ -76,4 +76,13 @@ u64 lake_rtc_frequency(void)
     } 
     return LAKE_US_PER_SECOND;
 }
+
+u64 lake_time_ns(void)
+{
+    u64 const counter = lake_rtc_counter();
+    u64 const frequency = lake_rtc_frequency();
+    if (lake_likely(frequency == (u64)LAKE_NS_PER_SECOND)) 
+        return counter;
+    return (counter / frequency) * LAKE_NS_PER_SECOND + (counter % frequency) * LAKE_NS_PER_SECOND / frequency;
+}
 #endif /* LAKE_PLATFORM_UNIX */
@@ -2,138 +2,218 @@
 #include <lake/math/bits.h>
 
 /** We use a bitmap to represent our blocks of free memory. One bit in the bitmap 
- *  is one block of LAKE_TAGGED_HEAP_BLOCK_SIZE, with one byte we represent 8 blocks. */
-#define IMPL_HEAP_BITMAP_TEMPLATE(FUNC, OPERATION)                                  \
-    LAKE_HOT_FN LAKE_NONNULL_ALL                                                    \
-    void LAKECALL FUNC##_heap_bitmap(                                               \
-        atomic_u8  *bitmap,                                                         \
-        usize const offset,                                                         \
-        usize const size)                                                           \
-{                                                                                   \
-    if (size == 0) return;                                                          \
-    usize const position   = __position_from_block(offset);                         \
-    usize const head_index = __index_from_position(position);                       \
-    usize const count      = 1 + __index_from_page(size);                           \
-    usize const tail_index = head_index + count - 1;                                \
-                                                                                    \
-    u8 bitmask = ~((1 << (position & 0x07)) - 1);                                   \
-    for (usize i = 0; i < count; i++) {                                             \
-        usize index = head_index + i;                                               \
-                                                                                    \
-        /* XOR'ing the bitmask will leave blocks beyond the range untouched */      \
-        if (index == tail_index)                                                    \
-            bitmask ^= ~((1 << ((position + count) & 0x07)) - 1);                   \
-                                                                                    \
-        /* set the blocks as in use (bits set to 0) or as free (bits set to 1) */   \
-        OPERATION;                                                                  \
-        bitmask = 0xFF;                                                             \
-    }                                                                               \
+ *  is one block of LAKE_TAGGED_HEAP_BLOCK_SIZE, with one u64 word we represent 64 blocks. 
+ *  A bit of the summary is set if it's word may have free blocks, a search only visits 
+ *  words that the summary points to, so it won't walk over long runs of blocks in use. */
+LAKE_FORCE_INLINE u64 bitmap_word_mask(usize word, usize position, usize end)
+{
+    u64 mask = ~0llu;
+    if (__index_from_position(position) == word)
+        mask &= ~0llu << (position & 63);
+    if (__index_from_position(end - 1) == word && (end & 63))
+        mask &= ~(~0llu << (end & 63));
+    return mask;
 }
-/** Sets a range of blocks in the heap as in use. */
-IMPL_HEAP_BITMAP_TEMPLATE(acquire, lake_atomic_and_explicit(&bitmap[index], ~bitmask, lake_memory_model_acquire))
 
-/** Sets a range of blocks in the heap as free to take. */
-IMPL_HEAP_BITMAP_TEMPLATE(release, lake_atomic_or_explicit(&bitmap[index], bitmask, lake_memory_model_release))
+/** The summary is only a hint, a cleared bit is checked again so a concurrent release isn't lost. */
+static void clear_summary_bit(usize word)
+{
+    atomic_u64 *summary = &g_bedrock->bitmap_summary[word >> 6];
+    u64 const bit = 1llu << (word & 63);
 
-/** A single block allocation (LAKE_TAGGED_HEAP_BLOCK_SIZE). We don't own the growth 
- *  sync here and NEVER wait on it, instead the sync value is passed in as the ceiling 
- *  for bitmap query. If a free block is found, we commit it to the bitmap immediately. */
-LAKE_HOT_FN LAKE_PURE_FN
-static usize LAKECALL find_free_block(usize const offset, usize const ceiling)
+    lake_atomic_and_explicit(summary, ~bit, lake_memory_model_acq_rel);
+    if (lake_atomic_read_explicit(&g_bedrock->bitmap[word], lake_memory_model_acquire) != 0)
+        lake_atomic_or_explicit(summary, bit, lake_memory_model_release);
+}
+
+void acquire_heap_bitmap(usize const offset, usize const size)
 {
-    if (offset >= ceiling) return 0lu;
+    if (size == 0) return;
+    usize const position = __position_from_block(offset);
+    usize const end = position + __position_from_block(lake_align(size, LAKE_TAGGED_HEAP_BLOCK_SIZE));
+
+    for (usize word = __index_from_position(position); word <= __index_from_position(end - 1); word++) {
+        u64 const mask = bitmap_word_mask(word, position, end);
+        u64 const prev = lake_atomic_and_explicit(&g_bedrock->bitmap[word], ~mask, lake_memory_model_acquire);
+        if ((prev & ~mask) == 0) clear_summary_bit(word);
+    }
+}
 
-    atomic_u8 *bitmap = g_bedrock->bitmap;
-    usize const index = __index_from_page(offset);
-    usize const range = 1 + __index_from_page(ceiling) - index;
+/** Sets blocks of a word as free, the summary learns about the word if it had none. */
+LAKE_FORCE_INLINE void release_bitmap_word(usize word, u64 mask)
+{
+    u64 const prev = lake_atomic_or_explicit(&g_bedrock->bitmap[word], mask, lake_memory_model_release);
+    if (prev == 0) 
+        lake_atomic_or_explicit(&g_bedrock->bitmap_summary[word >> 6], 1llu << (word & 63), lake_memory_model_release);
+}
 
-    /* try until we either succeed or hit the ceiling */
-    for (;;) {
-        usize bits = lake_ffsbit((u8 const *)&bitmap[index], range);
+void release_heap_bitmap(usize const offset, usize const size)
+{
+    if (size == 0) return;
+    usize const position = __position_from_block(offset);
+    usize const end = position + __position_from_block(lake_align(size, LAKE_TAGGED_HEAP_BLOCK_SIZE));
 
-        /* `lake_ffsbit()` returns a 1-based value, or 0 if no bits are set.
-         * This is also why later we must decrement the bits value. */
-        if (!bits) return 0lu;
+    for (usize word = __index_from_position(position); word <= __index_from_position(end - 1); word++)
+        release_bitmap_word(word, bitmap_word_mask(word, position, end));
+}
 
-        /* The `__position_from_index` will align the value of `pos`
-         * to a byte boundary (index is: `pos >> 3lu`). */
-        bits += __position_from_index(index) - 1; /* decrement to get a 0-based value */
+void retire_heap_bitmap(usize const offset, usize const size)
+{
+    if (size == 0) return;
+    usize const position = __position_from_block(offset);
+    usize const end = position + __position_from_block(lake_align(size, LAKE_TAGGED_HEAP_BLOCK_SIZE));
+
+    /* the blocks are marked dirty before a trim pass can see them free */
+    for (usize word = __index_from_position(position); word <= __index_from_position(end - 1); word++) {
+        u64 const mask = bitmap_word_mask(word, position, end);
+        lake_atomic_or_explicit(&g_bedrock->bitmap_dirty[word], mask, lake_memory_model_relaxed);
+        lake_atomic_and_explicit(&g_bedrock->bitmap_idle[word], ~mask, lake_memory_model_relaxed);
+        release_bitmap_word(word, mask);
+    }
+}
 
-        /* we may have overshot on edging (!! holy moly) bytes */
-        if (lake_unlikely(bits >= __position_from_block(ceiling)))
-            return 0lu;
+/** Tries to take a range of blocks in one go. If any of them was taken in the meantime, 
+ *  the blocks already taken by this call are given back, and the range stays untouched. */
+static bool try_acquire_heap_bitmap(usize const position, usize const end)
+{
+    for (usize word = __index_from_position(position); word <= __index_from_position(end - 1); word++) {
+        u64 const mask = bitmap_word_mask(word, position, end);
+        u64 const prev = lake_atomic_and_explicit(&g_bedrock->bitmap[word], ~mask, lake_memory_model_acquire);
+
+        if (lake_unlikely((prev & mask) != mask)) {
+            /* only give back what this call took */
+            if (prev & mask) release_bitmap_word(word, prev & mask);
+            if (word > __index_from_position(position))
+                release_heap_bitmap(__block_from_position(position), __block_from_position(__position_from_index(word) - position));
+            return false;
+        }
+        if ((prev & ~mask) == 0) clear_summary_bit(word);
+    }
+    return true;
+}
 
-        /* try to acquire the block */
-        u8 const bitmask = (1u << (bits & 0x07));
-        u8 const prev = lake_atomic_and_explicit(&bitmap[__index_from_position(bits)], ~bitmask, lake_memory_model_acquire);
+/** Returns the first word at or after `word` that the summary marks as having free blocks, 
+ *  or `word_end` if there is none. Past the first summary word the search uses `lake_ffsbit()`, 
+ *  so with AVX2 a large budget is searched 256 words (16384 blocks) at a time. */
+static usize next_summary_word(usize word, usize word_end)
+{
+    atomic_u64 const *summary = g_bedrock->bitmap_summary;
+    if (word >= word_end) return word_end;
+
+    usize const s = word >> 6;
+    u64 const bits = lake_atomic_read_explicit(&summary[s], lake_memory_model_acquire) & (~0llu << (word & 63));
+    if (bits) {
+        word = (s << 6) + lake_ctz64(bits);
+    } else {
+        usize const s_end = (word_end + 63) >> 6;
+        if (s + 1 >= s_end) return word_end;
 
-        /* Double check to avoid any possibility of data races. If this is true, 
-         * then the bitmask wrote to a block already in use. Nothing changed, 
-         * and we can't claim this block for ourselves. */
-        if ((prev & bitmask) == bitmask) 
-            return __block_from_position(bits);
+        /* `lake_ffsbit()` returns a 1-based value, or 0 if no bits are set */
+        u64 const bit = lake_ffsbit((u8 const *)&summary[s + 1], (s_end - s - 1) * sizeof(u64));
+        if (!bit) return word_end;
+        word = ((s + 1) << 6) + bit - 1;
     }
-    LAKE_UNREACHABLE;
+    return lake_min(word, word_end);
+}
+
+/** A single block allocation (LAKE_TAGGED_HEAP_BLOCK_SIZE). We don't own the growth 
+ *  sync here, but we are safe as long as the ceiling is respected. If a free block is 
+ *  found, we commit it to the bitmap immediately. */
+LAKE_HOT_FN
+static usize LAKECALL find_free_block(usize const offset, usize const ceiling)
+{
+    if (offset >= ceiling) return 0lu;
+
+    atomic_u64 *bitmap = g_bedrock->bitmap;
+    usize const position = __position_from_block(offset);
+    usize const end = __position_from_block(ceiling);
+    if (position >= end) return 0lu;
+    usize const word_end = __index_from_position(end - 1) + 1;
+
+    for (usize word = next_summary_word(__index_from_position(position), word_end); 
+         word < word_end; word = next_summary_word(word + 1, word_end))
+    {
+        u64 const mask = bitmap_word_mask(word, position, end);
+        for (;;) {
+            u64 const free = lake_atomic_read_explicit(&bitmap[word], lake_memory_model_relaxed);
+            if (free == 0) clear_summary_bit(word);
+            if ((free & mask) == 0) break;
+
+            /* try to acquire the block */
+            u64 const bit = 1llu << lake_ctz64(free & mask);
+            u64 const prev = lake_atomic_and_explicit(&bitmap[word], ~bit, lake_memory_model_acquire);
+
+            /* If the bit was cleared before us, the block is in use by another thread. 
+             * Nothing changed, and we can't claim this block for ourselves. */
+            if (prev & bit) {
+                if (prev == bit) clear_summary_bit(word);
+                return __block_from_position(__position_from_index(word) + lake_ctz64(bit));
+            }
+        }
+    }
+    return 0lu;
 }
 
-/** Tries to find a range of contiguous memory blocks to fulfill a larger request.
- *  If this function was called, it's assumed we own the sync counter. */
-LAKE_HOT_FN LAKE_PURE_FN LAKE_NONNULL_ALL
+/** Tries to find a range of contiguous free blocks to fulfill a larger request, starting 
+ *  within [offset, ceiling). The range may reach past the ceiling, the caller must check. 
+ *  Only words with free blocks are visited, a run is broken by any word skipped on the way. 
+ *  Nothing is acquired here, the bitmap may change before the caller acquires the range. */
+LAKE_HOT_FN
 static usize LAKECALL find_free_blocks_range(
         usize const   offset,
         usize const   request, 
-        usize const   ceiling, 
-        atomic_usize *sync)
+        usize const   ceiling)
 {
-    atomic_u8 const *bitmap = g_bedrock->bitmap; /* we won't write to it here */
+    atomic_u64 const *bitmap = g_bedrock->bitmap;
     usize const blocks = __position_from_block(request);
-    usize const head_index = __index_from_page(offset);
-    usize const tail_index = __index_from_page(ceiling);
+    usize const position = __position_from_block(offset);
+    usize const end = lake_min(__position_from_block(ceiling) + blocks, __position_from_block(g_bedrock->budget));
 
     /* early checks to invalidate the request */
-    if (head_index > tail_index || !blocks || blocks < __position_from_block((ceiling - offset)))
+    if (!blocks || position >= end || blocks > end - position)
         return 0lu;
 
+    usize const word_end = __index_from_position(end - 1) + 1;
     usize candidate = 0lu;
     usize current = 0lu;
 
-    /* query the bitmap */
-    for (usize i = head_index; i <= tail_index; i++) {
-        /* a byte represents a range of 8 blocks */
-        u8 const byte = lake_atomic_read(&bitmap[i]);
+    for (usize word = next_summary_word(__index_from_position(position), word_end); word < word_end; ) {
+        u64 const mask = bitmap_word_mask(word, position, end);
+        u64 free = lake_atomic_read_explicit(&bitmap[word], lake_memory_model_relaxed) & mask;
+        usize bit = 0;
 
-        /* a full free byte is convenient */
-        if (byte == 0xff) {
-            if (current == 0lu)
-                candidate = __position_from_index(i);
-            current += 8;
+        /* count the run that continues from the previous word */
+        if (current) {
+            usize const run = (~free == 0) ? 64 : (usize)lake_ctz64(~free);
+            current += run;
             if (current >= blocks) return __block_from_position(candidate);
-        } else if (byte != 0) {
-            u8 bitmask = 0xff;
-            usize bit = 0;
-
-            /* check individual blocks */
-            while (bitmask && bit < 8) {
-                if (byte & bitmask) {
-                    if (current == 0lu)
-                        candidate = __position_from_index(i) + bit;
-                    current++;
-                    bitmask >>= 1;
-                    bit++;
-                } else {
-                    lake_atomic_write(sync, __block_from_position(__position_from_index(i)));
-                    current = 0lu;
-                    bitmask = 0lu;
-                }
-                if (current >= blocks) return __block_from_position(candidate);
+            if (run < 64) { current = 0; bit = run; }
+        }
+        /* find a run within the word, it's last run may continue into the next */
+        while (!current && bit < 64) {
+            u64 const rest = free & (~0llu << bit);
+            if (rest == 0) break;
+            bit = lake_ctz64(rest);
+            u64 const zeroes = ~free & (~0llu << bit);
+            usize const run_end = zeroes ? (usize)lake_ctz64(zeroes) : 64;
+
+            if (__position_from_index(word) + bit >= __position_from_block(ceiling)) 
+                return 0lu;
+            if (run_end - bit >= blocks) 
+                return __block_from_position(__position_from_index(word) + bit);
+            if (run_end == 64) {
+                candidate = __position_from_index(word) + bit;
+                current = run_end - bit;
             }
+            bit = run_end;
+        }
+        /* a run can continue only into the very next word */
+        if (current) {
+            word++;
         } else {
-            /* currently queried free memory range does not satisfy our request */
-            lake_atomic_write(sync, __page_from_index(i));
-            current = 0lu;
+            word = next_summary_word(word + 1, word_end);
         }
     }
-    /* either out of host memory or the memory is fragmented... */
     return 0lu;
 }
 
@@ -154,9 +234,19 @@ usize acquire_blocks(usize const block_aligned)
             usize const ceiling = sync_value ? lake_min(sync_value, commitment) : commitment;
             usize const offset = find_free_block(roots_end, ceiling);
             if (offset) {
-                return offset;
+                /* the search may have started before `lake_thadvise()` released the top of the 
+                 * commitment, a block taken from there is given back. The commitment is lowered 
+                 * before the released blocks are set free, so it's seen here after the claim. */
+                commitment = lake_atomic_read_explicit(&g_bedrock->commitment, lake_memory_model_acquire);
+                if (lake_likely(offset + LAKE_TAGGED_HEAP_BLOCK_SIZE <= commitment))
+                    return offset;
+                release_heap_bitmap(offset, LAKE_TAGGED_HEAP_BLOCK_SIZE);
+                continue;
+            }
+            if (sync_value) {
+                commitment = lake_atomic_read_explicit(&g_bedrock->commitment, lake_memory_model_acquire);
+                continue;
             }
-            if (sync_value) continue;
         }
         usize expected = 0lu;
         if (!lake_atomic_compare_exchange_weak_explicit(sync, &expected,
@@ -164,44 +254,46 @@ usize acquire_blocks(usize const block_aligned)
         { /* another thread owns the growth sync */
             continue;
         }
-        usize offset = 0;
-
         /* in case it changed */
         commitment = lake_atomic_read_explicit(&g_bedrock->commitment, lake_memory_model_acquire);
+        /* ranges are acquired as a whole, so single blocks may be taken below the commitment meanwhile */
+        lake_atomic_write_explicit(sync, commitment, lake_memory_model_release);
+
+        usize offset = 0;
         /** This step can be skipped in case we came here with the implication, that there is 
          *  not enough free commited memory right now to satisfy even a minimal allocation. */
         if (block_aligned > LAKE_TAGGED_HEAP_BLOCK_SIZE) {
-            /* When it's a non-zero value, we can satisfy the allocation from existing resources. */
-            offset = find_free_blocks_range(roots_end, block_aligned, commitment, sync);
+            usize from = roots_end;
+            for (;;) {
+                /* When it's a non-zero value, we can satisfy the allocation from existing resources. */
+                offset = find_free_blocks_range(from, block_aligned, commitment);
+                if (!offset || try_acquire_heap_bitmap(__position_from_block(offset), __position_from_block(offset + block_aligned)))
+                    break;
+                /* lost some of these blocks to another thread */
+                from = offset + LAKE_TAGGED_HEAP_BLOCK_SIZE;
+            }
             if (offset && offset + block_aligned <= commitment) {
-                /* write changes and drop the sync */
-                acquire_heap_bitmap(g_bedrock->bitmap, offset, block_aligned);
                 lake_atomic_write_explicit(sync, 0lu, lake_memory_model_release);
                 return offset;
             }
         }
+        /* a range found at the end of the commitment is acquired already, it grows from there */
+        bool const acquired = offset != 0;
         if (!offset) offset = commitment;
-
-        lake_atomic_write_explicit(sync, offset, lake_memory_model_release);
-        usize new_ceiling = block_aligned - (commitment - offset);
+        usize const new_ceiling = block_aligned - (commitment - offset);
 
         /* we must commit memory for new resources */
         if (lake_unlikely(new_ceiling + commitment > g_bedrock->budget || 
             !sys_madvise((void *)g_bedrock, commitment, new_ceiling, true)))
         {
-            /* try one last time... */
-            new_ceiling = LAKE_TAGGED_HEAP_BLOCK_SIZE - (commitment - offset);
-            if (lake_unlikely(new_ceiling + commitment > g_bedrock->budget || 
-                !sys_madvise((void *)g_bedrock, commitment, new_ceiling, true))) 
-            {
-                lake_error("Can't commit new resources allocation: %s.", 
-                        (new_ceiling + commitment > g_bedrock->budget)
-                        ? "framework budget drained" : "out of host memory");
-                lake_atomic_write_explicit(sync, 0lu, lake_memory_model_release);
-                return 0lu;
-            }
+            lake_error("Can't commit new resources allocation: %s.", 
+                    (new_ceiling + commitment > g_bedrock->budget)
+                    ? "framework budget drained" : "out of host memory");
+            if (acquired) release_heap_bitmap(offset, block_aligned);
+            lake_atomic_write_explicit(sync, 0lu, lake_memory_model_release);
+            return 0lu;
         }
-        acquire_heap_bitmap(g_bedrock->bitmap, offset, block_aligned);
+        if (!acquired) acquire_heap_bitmap(offset, block_aligned);
         lake_atomic_write_explicit(&g_bedrock->commitment, new_ceiling + commitment, lake_memory_model_release);
         lake_atomic_write_explicit(sync, 0lu, lake_memory_model_release);
         return offset;
@@ -241,6 +333,21 @@ static struct region *LAKECALL construct_tagged_heap_region(
     return (struct region *)(void *)(uptr)(raw + tail->v + aligned);
 }
 
+/** Returns the region after the tail of the heap, it becomes the new tail. Regions left 
+ *  from a previous lifetime of the heap are reused. The heap's spinlock must be held. */
+static struct region *LAKECALL next_tagged_heap_region(struct tagged_heap *th, lake_heap_tag tag)
+{
+    /* a heap that was never used has no tail yet */
+    if (th->tail == nullptr) th->tail = &th->head;
+    struct region *tail = th->tail;
+
+    /* only the head of an empty heap */
+    if (tail->alloc == 0lu) return tail;
+    if (tail->next == nullptr)
+        tail->next = construct_tagged_heap_region(tag, LAKE_TAGGED_HEAP_BLOCK_SIZE);
+    return th->tail = tail->next;
+}
+
 LAKE_HOT_FN LAKE_MALLOC
 static void *LAKECALL allocate_from_tagged_heap(struct tagged_heap *th, usize size, u32 align)
 {
@@ -252,7 +359,7 @@ static void *LAKECALL allocate_from_tagged_heap(struct tagged_heap *th, usize si
     usize const block_aligned = lake_align(size, LAKE_TAGGED_HEAP_BLOCK_SIZE);
 
     lake_spinlock_acquire(&th->spinlock);
-    if (lake_unlikely(th->head.alloc = 0lu)) {
+    if (lake_unlikely(th->head.alloc == 0lu)) {
         th->head.v = acquire_blocks(block_aligned);
         th->tail = &th->head;
 
@@ -293,8 +400,7 @@ static void *LAKECALL allocate_from_tagged_heap(struct tagged_heap *th, usize si
     }
 
     /* we could not yet satisfy the allocation, so grab a new arena page */
-    struct region *next = construct_tagged_heap_region(tag, block_aligned);
-    th->tail = th->tail->next = next;
+    struct region *next = next_tagged_heap_region(th, tag);
     next->v = acquire_blocks(block_aligned); 
 
     if (lake_unlikely(next->v == 0lu)) {
@@ -308,75 +414,355 @@ static void *LAKECALL allocate_from_tagged_heap(struct tagged_heap *th, usize si
     return (void *)(uptr)(raw + next->v);
 }
 
-void *lake_thalloc(lake_heap_tag tag, usize size, usize align)
+/** Fibonacci hashing, tags are often small values that differ only in the low bits. */
+LAKE_FORCE_INLINE u32 hash_heap_tag(lake_heap_tag tag)
+{ return (u32)(((u64)tag * 0x9e3779b97f4a7c15llu) >> 32); }
+
+/** Returns the slot of the tag in the lookup table, or of the empty slot that ends it's probing. 
+ *  The table is at least twice the count of heaps, so it's never full. Without the lock held, 
+ *  a heap that is moved or removed meanwhile may be missed, but a heap found is never wrong. */
+static u32 find_heap_lookup_slot(lake_heap_tag tag, struct tagged_heap **out_th)
 {
-    lake_dbg_assert(lake_is_pow2(align), LAKE_INVALID_PARAMETERS, "alignment must be a power of 2");
+    u32 const mask = g_bedrock->heap_lookup_mask;
+
+    for (u32 h = hash_heap_tag(tag) & mask;; h = (h + 1) & mask) {
+        struct tagged_heap *th = (struct tagged_heap *)
+            lake_atomic_read_explicit(&g_bedrock->heap_lookup[h], lake_memory_model_acquire);
+        if (th == nullptr || lake_atomic_read_explicit(&th->tag, lake_memory_model_acquire) == tag) {
+            *out_th = th;
+            return h;
+        }
+    }
+    LAKE_UNREACHABLE;
+}
 
-    if (lake_unlikely(size == 0 || align == 0))
-        return nullptr;
+/** Removes an entry with backward shifting, so no tombstones are left to slow down probing. 
+ *  Every later entry of the cluster that can't be found past the hole is moved into it. 
+ *  The lookup lock must be held, all entries in the table have their tags set. */
+static void remove_heap_lookup_slot(u32 hole)
+{
+    atomic_uptr *table = g_bedrock->heap_lookup;
+    u32 const mask = g_bedrock->heap_lookup_mask;
 
-    if (tag == 0) 
-        return allocate_from_tagged_heap(&g_bedrock->roots, size, align);
+    for (u32 h = (hole + 1) & mask;; h = (h + 1) & mask) {
+        uptr const entry = lake_atomic_read_explicit(&table[h], lake_memory_model_relaxed);
+        if (entry == 0) break;
 
-    /* if a tag exists, it will be found here */
-    usize tail = lake_atomic_read_explicit(&g_bedrock->tagged_heap_tail, lake_memory_model_acquire);
-    for (usize i = 0; i < tail; i++) {
-        struct tagged_heap *th = g_bedrock->tagged_heaps[i];
-        if (tag == lake_atomic_read(&th->tag))
-            return allocate_from_tagged_heap(th, size, align);
+        /* the entry stays if it's home slot lies cyclically within (hole, h] */
+        u32 const home = hash_heap_tag(lake_atomic_read_explicit(&((struct tagged_heap *)entry)->tag, lake_memory_model_relaxed)) & mask;
+        if (hole <= h ? (hole < home && home <= h) : (hole < home || home <= h))
+            continue;
+        lake_atomic_write_explicit(&table[hole], entry, lake_memory_model_release);
+        hole = h;
     }
+    lake_atomic_write_explicit(&table[hole], 0lu, lake_memory_model_release);
+}
 
-    /* prepare a new tagged heap */
-    for (;;) {
-        if (lake_unlikely(tail >= (u32)g_bedrock->tagged_heap_count)) {
-            lake_error("Reached maximum count of unique tagged heaps (%lu), can't satisfy" 
-                    " the allocation for tag `%X`, as the heap does not yet exist.", tail, tag);
+/** Finds the heap of a tag, or prepares a new one if the tag is not yet in use. */
+static struct tagged_heap *LAKECALL find_tagged_heap(lake_heap_tag tag)
+{
+    /* if a tag exists, it will be found here, almost always */
+    struct tagged_heap *th;
+    find_heap_lookup_slot(tag, &th);
+    if (lake_likely(th != nullptr)) return th;
+
+    /* the tag may have been created or moved meanwhile, look again under the lock */
+    lake_spinlock_acquire(&g_bedrock->heap_lookup_lock);
+    u32 const slot = find_heap_lookup_slot(tag, &th);
+    if (th == nullptr) {
+        if (lake_unlikely(g_bedrock->tagged_heap_free_count == 0)) {
+            lake_spinlock_release(&g_bedrock->heap_lookup_lock);
+            lake_error("Reached maximum count of unique tagged heaps (%d), can't satisfy" 
+                    " the allocation for tag `%X`, as the heap does not yet exist.", g_bedrock->tagged_heap_count, tag);
             return nullptr;
         }
-        /* we are using the roots tag to identify free heaps */
-        lake_heap_tag expected = 0;
-        struct tagged_heap *th = g_bedrock->tagged_heaps[tail];
+        /* prepare a new tagged heap, it's published with the tag already set */
+        th = g_bedrock->tagged_heaps[--g_bedrock->tagged_heap_free_count];
+        lake_atomic_write_explicit(&th->tag, tag, lake_memory_model_release);
+        lake_atomic_write_explicit(&g_bedrock->heap_lookup[slot], (uptr)th, lake_memory_model_release);
+    }
+    lake_spinlock_release(&g_bedrock->heap_lookup_lock);
+    return th;
+}
 
-        if (lake_atomic_compare_exchange_weak_explicit(&th->tag, &expected, tag,
-                lake_memory_model_release, lake_memory_model_relaxed))
+/** Takes a region for a cache entry, while holding the heap's spinlock only for the time it 
+ *  takes. Regions handed back by evicted entries are taken over first, if they have enough 
+ *  room left. Otherwise it acquires new blocks, every refill of the heap's lifetime takes twice 
+ *  as many as the one before, up to TAGGED_HEAP_CACHE_BLOCKS, so a tag used rarely won't hold 
+ *  much memory. */
+static bool LAKECALL refill_heap_cache(struct tagged_heap_cache_entry *entry)
+{
+    struct tagged_heap *th = entry->th;
+
+    lake_spinlock_acquire(&th->spinlock);
+    /* the regions of a heap freed since the lookup may belong to a new lifetime already */
+    if (th->cache_returned_count > 0 && lake_atomic_read_explicit(&th->generation, lake_memory_model_acquire) == entry->generation) {
+        for (struct region *page = &th->head; page != nullptr && page->alloc != 0; page = page->next) {
+            if (page->alloc - page->offset < TAGGED_HEAP_CACHE_MAX_SIZE) continue;
+
+            entry->region = page;
+            entry->cursor = page->v + page->offset;
+            entry->end = page->v + page->alloc;
+            page->offset = page->alloc;
+            th->cache_returned_count--;
+            lake_spinlock_release(&th->spinlock);
+            return true;
+        }
+        /* the shared path took the room left in them */
+        th->cache_returned_count = 0;
+    }
+    u32 const count = th->cache_refill_count = lake_min(lake_max(th->cache_refill_count << 1, 1u), TAGGED_HEAP_CACHE_BLOCKS);
+    for (u32 i = 0; i < count; i++) {
+        usize const block = acquire_blocks(LAKE_TAGGED_HEAP_BLOCK_SIZE);
+        if (lake_unlikely(block == 0lu)) break;
+
+        /* the region is full for the shared path, until the entry hands it back */
+        struct region *page = next_tagged_heap_region(th, entry->tag);
+        page->v = block;
+        page->offset = page->alloc = LAKE_TAGGED_HEAP_BLOCK_SIZE;
+        entry->reserved[entry->reserved_count++] = page;
+    }
+    lake_spinlock_release(&th->spinlock);
+
+    if (lake_unlikely(entry->reserved_count == 0)) {
+        lake_error("Host memory failure, can't acquire a block for the cache of tagged heap %X.", entry->tag);
+        return false;
+    }
+    return true;
+}
+
+/** Hands the regions of an evicted entry back to it's heap. The rest of the current region is 
+ *  open to the shared path again, the reserved regions are whole. A refill of any worker takes 
+ *  them over, so a worker that cycles through more tags than it caches won't acquire a new 
+ *  block every time a tag comes back. */
+static void LAKECALL return_heap_cache_entry(struct tagged_heap_cache_entry *entry)
+{
+    struct tagged_heap *th = entry->th;
+
+    lake_spinlock_acquire(&th->spinlock);
+    /* a freed heap released the blocks already, it's regions may be in use by a new lifetime */
+    if (lake_atomic_read_explicit(&th->generation, lake_memory_model_acquire) == entry->generation) {
+        if (entry->region != nullptr) {
+            entry->region->offset = entry->cursor - entry->region->v;
+            th->cache_returned_count++;
+        }
+        for (u32 i = 0; i < entry->reserved_count; i++)
+            entry->reserved[i]->offset = 0;
+        th->cache_returned_count += entry->reserved_count;
+    }
+    lake_spinlock_release(&th->spinlock);
+}
+
+/** Workers allocate from blocks of their own, without touching the heap's spinlock 
+ *  or the bitmap until the blocks cached for the tag run out. */
+LAKE_HOT_FN LAKE_MALLOC
+static void *LAKECALL allocate_from_heap_cache(struct tagged_heap_cache *cache, lake_heap_tag tag, usize size, usize align)
+{
+    u8 *raw = (u8 *)g_bedrock;
+    struct tagged_heap_cache_entry *entry = nullptr;
+
+    for (u32 i = 0; i < TAGGED_HEAP_CACHE_TAGS; i++) {
+        struct tagged_heap_cache_entry *e = &cache->entries[i];
+        if (e->th == nullptr || e->tag != tag) continue;
+
+        /* the tag was freed since, it's blocks were released together with it's heap */
+        if (lake_atomic_read_explicit(&e->th->tag, lake_memory_model_acquire) != tag ||
+            lake_atomic_read_explicit(&e->th->generation, lake_memory_model_acquire) != e->generation)
         {
-            lake_atomic_add_explicit(&g_bedrock->tagged_heap_tail, 1lu, lake_memory_model_release);
-            return allocate_from_tagged_heap(th, size, align);
+            *e = (struct tagged_heap_cache_entry){0};
+            break;
         }
-        tail = lake_atomic_read_explicit(&g_bedrock->tagged_heap_tail, lake_memory_model_acquire);
+        entry = e;
+        break;
+    }
+    if (lake_unlikely(entry == nullptr)) {
+        struct tagged_heap *th = find_tagged_heap(tag);
+        if (th == nullptr) return nullptr;
+
+        for (u32 i = 0; i < TAGGED_HEAP_CACHE_TAGS && entry == nullptr; i++)
+            if (cache->entries[i].th == nullptr) entry = &cache->entries[i];
+        if (entry == nullptr) {
+            entry = &cache->entries[cache->victim];
+            cache->victim = (cache->victim + 1) % TAGGED_HEAP_CACHE_TAGS;
+            return_heap_cache_entry(entry);
+        }
+        *entry = (struct tagged_heap_cache_entry){
+            .th = th,
+            .tag = tag,
+            .generation = lake_atomic_read_explicit(&th->generation, lake_memory_model_acquire),
+        };
+    }
+
+    for (;;) {
+        usize const aligned = lake_align(entry->cursor, align);
+        if (lake_likely(aligned + size <= entry->end)) {
+            entry->cursor = aligned + size;
+            return (void *)(uptr)(raw + aligned);
+        }
+        if (entry->reserved_count == 0) {
+            if (!refill_heap_cache(entry)) return nullptr;
+            /* a region was taken over, with the cursor set */
+            if (entry->reserved_count == 0) continue;
+        }
+        struct region *page = entry->reserved[--entry->reserved_count];
+        entry->region = page;
+        entry->cursor = page->v;
+        entry->end = page->v + page->alloc;
     }
-    LAKE_UNREACHABLE;
+}
+
+void *lake_thalloc(lake_heap_tag tag, usize size, usize align)
+{
+    lake_dbg_assert(lake_is_pow2(align), LAKE_INVALID_PARAMETERS, "alignment must be a power of 2");
+
+    if (lake_unlikely(size == 0 || align == 0))
+        return nullptr;
+
+    if (tag == 0) 
+        return allocate_from_tagged_heap(&g_bedrock->roots, size, align);
+
+    /* the roots are never freed, so only other tags are worth a cache */
+    s32 const thread_idx = find_worker_thread_index();
+    if (lake_likely(thread_idx >= 0 && size <= TAGGED_HEAP_CACHE_MAX_SIZE && align <= TAGGED_HEAP_CACHE_MAX_SIZE))
+        return allocate_from_heap_cache(&g_bedrock->heap_caches[thread_idx], tag, size, align);
+
+    struct tagged_heap *th = find_tagged_heap(tag);
+    if (th == nullptr) return nullptr;
+    return allocate_from_tagged_heap(th, size, align);
 }
 
 void lake_thfree(lake_heap_tag tag)
 {
-    usize const tail = lake_atomic_read_explicit(&g_bedrock->tagged_heap_tail, lake_memory_model_relaxed);
     lake_dbg_assert(tag != 0, LAKE_ERROR_NOT_PERMITTED, "roots tagged heap MUST NOT be freed");
 
-    for (usize i = 0; i < tail; i++) {
-        struct tagged_heap *th = g_bedrock->tagged_heaps[i];
+    struct tagged_heap *th;
+    lake_spinlock_acquire(&g_bedrock->heap_lookup_lock);
+    u32 const slot = find_heap_lookup_slot(tag, &th);
+    if (th == nullptr) {
+        lake_spinlock_release(&g_bedrock->heap_lookup_lock);
+        return;
+    }
+    /* the tag can be used again right away, it will get a new heap */
+    lake_atomic_write_explicit(&th->tag, 0u, lake_memory_model_release);
+    remove_heap_lookup_slot(slot);
+    /* cached blocks of this lifetime must not be used by workers anymore */
+    lake_atomic_add_explicit(&th->generation, 1u, lake_memory_model_release);
+    lake_spinlock_release(&g_bedrock->heap_lookup_lock);
+
+    lake_spinlock_acquire(&th->spinlock);
+    for (struct region *page = &th->head; page != nullptr; page = page->next) {
+        if (!page->alloc) break;
 
-        if (lake_atomic_compare_exchange_weak_explicit(&th->tag, &tag, 0u, 
-                lake_memory_model_release, lake_memory_model_relaxed))
-        {
-            usize const actual_tail = lake_atomic_sub_explicit(
-                    &g_bedrock->tagged_heap_tail, 1lu, lake_memory_model_release);
-            /* swap the heap with the tail */
-            g_bedrock->tagged_heaps[i] = g_bedrock->tagged_heaps[actual_tail];
-            g_bedrock->tagged_heaps[actual_tail] = th;
-            lake_spinlock_acquire(&th->spinlock);
-
-            for (struct region *page = &th->head; page != nullptr; page = page->next) {
-                if (!page->alloc) break;
-
-                release_heap_bitmap(g_bedrock->bitmap, page->v, page->alloc);
-                *page = (struct region){ .next = page->next };
+        retire_heap_bitmap(page->v, page->alloc);
+        *page = (struct region){ .next = page->next };
+    }
+    th->tail = &th->head;
+    th->cache_refill_count = 0;
+    th->cache_returned_count = 0;
+    lake_spinlock_release(&th->spinlock);
+
+    /* only an empty heap goes back to the stack */
+    lake_spinlock_acquire(&g_bedrock->heap_lookup_lock);
+    g_bedrock->tagged_heaps[g_bedrock->tagged_heap_free_count++] = th;
+    lake_spinlock_release(&g_bedrock->heap_lookup_lock);
+    arm_heap_trim();
+}
+
+LAKE_FORCE_INLINE u32 popcnt64(u64 v)
+{ return lake_popcnt_u32((u32)v) + lake_popcnt_u32((u32)(v >> 32)); }
+
+/** A trim pass. Blocks are trimmed from the end of the commitment down, as searches for free 
+ *  blocks start from the beginning. A block is acquired for the time it's pages are purged, 
+ *  so it can't be handed out meanwhile. Returns the count of purged blocks, `out_again` is 
+ *  set if blocks above the high water mark are left for another pass. */
+static usize trim_heap_pass(usize const high_water_mark_bytes, bool *out_again)
+{
+    atomic_u64 *bitmap = g_bedrock->bitmap;
+    usize const position = __position_from_block(g_bedrock->roots.head.alloc);
+    usize const end = __position_from_block(lake_atomic_read_explicit(&g_bedrock->commitment, lake_memory_model_acquire));
+    usize const high_water_mark = __position_from_block(high_water_mark_bytes);
+    *out_again = false;
+    if (position >= end) return 0;
+    usize const word_first = __index_from_position(position);
+    usize const word_end = __index_from_position(end - 1) + 1;
+
+    /* count the free blocks that still hold physical memory */
+    usize resident = 0;
+    for (usize word = word_first; word < word_end; word++) {
+        u64 const free = lake_atomic_read_explicit(&bitmap[word], lake_memory_model_relaxed);
+        u64 const dirty = lake_atomic_read_explicit(&g_bedrock->bitmap_dirty[word], lake_memory_model_relaxed);
+        resident += popcnt64(free & dirty & bitmap_word_mask(word, position, end));
+    }
+    usize excess = resident > high_water_mark ? resident - high_water_mark : 0;
+    usize waiting = 0;
+    usize purged_count = 0;
+
+    for (usize word = word_end; word-- > word_first;) {
+        u64 const mask = bitmap_word_mask(word, position, end);
+        u64 const free = lake_atomic_read_explicit(&bitmap[word], lake_memory_model_relaxed);
+        u64 const dirty = lake_atomic_read_explicit(&g_bedrock->bitmap_dirty[word], lake_memory_model_relaxed);
+        u64 const candidates = free & dirty & mask;
+        u64 idle = candidates & lake_atomic_read_explicit(&g_bedrock->bitmap_idle[word], lake_memory_model_relaxed);
+        u64 purged = 0;
+
+        while (excess && idle) {
+            u64 const bit = 1llu << lake_ctz64(idle);
+            idle &= ~bit;
+
+            /* the block is acquired for the time it's purged, or it was taken already */
+            u64 const prev = lake_atomic_and_explicit(&bitmap[word], ~bit, lake_memory_model_acquire);
+            if (!(prev & bit)) continue;
+            if (prev == bit) clear_summary_bit(word);
+
+            usize const offset = __block_from_position(__position_from_index(word) + lake_ctz64(bit));
+            if (sys_mpurge((void *)g_bedrock, offset, LAKE_TAGGED_HEAP_BLOCK_SIZE)) {
+                lake_atomic_and_explicit(&g_bedrock->bitmap_dirty[word], ~bit, lake_memory_model_relaxed);
+                purged |= bit;
+                purged_count++;
+                excess--;
             }
-            th->tail = &th->head;
-            lake_spinlock_release(&th->spinlock);
-            return;
+            release_bitmap_word(word, bit);
         }
+        /* blocks seen free now are purged by the next pass, unless they are retired before it */
+        u64 const seen = candidates & ~purged;
+        if (seen) lake_atomic_or_explicit(&g_bedrock->bitmap_idle[word], seen, lake_memory_model_relaxed);
+        waiting += popcnt64(seen);
     }
+    /* another pass is needed only if blocks above the high water mark are left */
+    *out_again = excess && waiting;
+    return purged_count;
+}
+
+/** The trim pass that runs as background work, armed by a freed tag. */
+static FN_LAKE_WORK(trim_heap_blocks, void *unused)
+{
+    (void)unused;
+    bool again;
+    trim_heap_pass(g_bedrock->high_water_mark, &again);
+
+    if (again) {
+        lake_work_details const work = { .procedure = trim_heap_blocks, .name = "tagged_heap/trim", .stack = lake_fiber_stack_small };
+        lake_submit_work_delayed(lake_work_priority_background, lake_time_ns() + TAGGED_HEAP_TRIM_INTERVAL_NS, 1, &work, nullptr);
+        return;
+    }
+    lake_atomic_write_explicit(&g_bedrock->trim_armed, 0u, lake_memory_model_release);
+}
+
+void arm_heap_trim(void)
+{
+    if (g_bedrock->high_water_mark >= g_bedrock->budget) return;
+    if (lake_atomic_read_explicit(&g_bedrock->trim_armed, lake_memory_model_relaxed)) return;
+    if (lake_atomic_exchange_explicit(&g_bedrock->trim_armed, 1u, lake_memory_model_acquire)) return;
+
+    lake_work_details const work = { .procedure = trim_heap_blocks, .name = "tagged_heap/trim", .stack = lake_fiber_stack_small };
+    lake_submit_work_delayed(lake_work_priority_background, lake_time_ns() + TAGGED_HEAP_TRIM_INTERVAL_NS, 1, &work, nullptr);
+}
+
+usize lake_thtrim(usize high_water_mark)
+{
+    lake_dbg_assert(g_bedrock != nullptr, LAKE_FRAMEWORK_REQUIRED, nullptr);
+    bool again;
+    return trim_heap_pass(high_water_mark, &again) * LAKE_TAGGED_HEAP_BLOCK_SIZE;
 }
 
 usize lake_thadvise(usize request, lake_thadvise_mode mode)
@@ -391,8 +777,10 @@ usize lake_thadvise(usize request, lake_thadvise_mode mode)
     usize const roots_end = g_bedrock->roots.head.alloc;
     bool const allow_suboptimal = (mode & lake_thadvise_suboptimal) ? true : false;
 
+    /* a failed exchange writes the value it found into `expected` */
     usize expected = 0lu;
     while (!lake_atomic_compare_exchange_weak_explicit(sync, &expected, roots_end, lake_memory_model_acquire, lake_memory_model_relaxed))
+        expected = 0lu;
 
     for (;;) {
         usize const page_aligned = lake_align(request, g_bedrock->page_size);
@@ -401,33 +789,40 @@ usize lake_thadvise(usize request, lake_thadvise_mode mode)
         /* try to release physical resources */
         if (mode & lake_thadvise_release) {
             usize const offset = commitment - page_aligned;
-            usize const index = __index_from_page(offset);
-            usize const range = __index_from_page(page_aligned);
-            usize const bits = (range + 1) * 8  /* full bytes of free blocks */
-                - (index & 0x07)                /* trim head index bits from range */ 
-                - ((index + range) & 0x07);     /* trim tail index bits from range */
-            u64 const popcnt = lake_popcnt((u8 const *)g_bedrock->bitmap + index, range);
+            usize const position = __position_from_block(offset);
+            usize const end = __position_from_block(commitment - 1) + 1;
+            /* Every block touched by the range must be free, the roots are never released. The 
+             * growth sync doesn't stop single blocks from being taken, the blocks are claimed 
+             * so no one can take them while their pages are released. */
+            bool const claimed = page_aligned <= commitment - roots_end && try_acquire_heap_bitmap(position, end);
 
             bool success = false;
-            if (popcnt >= bits && sys_madvise((void *)g_bedrock, offset, page_aligned, false)) {
+            if (claimed && sys_madvise((void *)g_bedrock, offset, page_aligned, false)) {
                 success = true;
-            } else if (allow_suboptimal) {
-                request >>= 1;
-                if (request > g_bedrock->page_size)
-                    continue;
+            } else {
+                if (claimed) release_heap_bitmap(__block_from_position(position), __block_from_position(end - position));
+                if (allow_suboptimal) {
+                    request >>= 1;
+                    if (request > g_bedrock->page_size)
+                        continue;
+                }
             }
 
-            lake_atomic_write_explicit(sync, 0lu, lake_memory_model_release);
             if (success) {
+                /* the pages are gone, a trim pass has nothing left to purge here */
+                for (usize word = __index_from_position(position); word <= __index_from_position(end - 1); word++)
+                    lake_atomic_and_explicit(&g_bedrock->bitmap_dirty[word], ~bitmap_word_mask(word, position, end), lake_memory_model_relaxed);
                 lake_atomic_write_explicit(&g_bedrock->commitment, offset, lake_memory_model_release);
-                return page_aligned;
+                /* only now the blocks are free again, anyone who takes one sees the lowered commitment */
+                release_heap_bitmap(__block_from_position(position), __block_from_position(end - position));
             }
-            return 0lu;
+            lake_atomic_write_explicit(sync, 0lu, lake_memory_model_release);
+            return success ? page_aligned : 0lu;
 
         /* try to commit physical resources */
         } else if (mode & lake_thadvise_commit) {
-            usize const offset = find_free_blocks_range(roots_end, page_aligned, commitment, sync);
-            if (offset) {
+            usize const offset = find_free_blocks_range(roots_end, page_aligned, commitment);
+            if (offset && offset + page_aligned <= commitment) {
                 /* there is enough free memory for this range */
                 lake_atomic_write_explicit(sync, 0lu, lake_memory_model_release);
                 return offset;
@@ -2471,9 +2471,11 @@ LAKEAPI FN_LAKE_INTERFACE_IMPL(moon, vulkan)
         query_physical_device_work[i].moon = moon;
         query_physical_device_work[i].name = name;
         query_physical_device_work[i].write.vk_physical_device = vk_physical_devices[i];
-        query_work[i].procedure = (PFN_lake_work)query_physical_device;
-        query_work[i].argument = (void *)&query_physical_device_work[i];
-        query_work[i].name = "moon::vulkan::query_physical_device";
+        query_work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)query_physical_device,
+            .argument = (void *)&query_physical_device_work[i],
+            .name = "moon::vulkan::query_physical_device",
+        };
     }
     lake_submit_work_and_yield(physical_device_count, query_work);
 
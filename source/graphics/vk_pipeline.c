@@ -791,9 +791,11 @@ static void LAKECALL destroy_raster_pipeline_assembly_shader_modules(
                 }, \
             }, \
             work[i].vk_create_info = &vk_create_infos[i]; \
-            work_details[i].procedure = (PFN_lake_work)populate_##T##_pipeline; \
-            work_details[i].argument = &work[i]; \
-            work_details[i].name = "populate " #T " pipeline create info"; \
+            work_details[i] = (lake_work_details){ \
+                .procedure = (PFN_lake_work)populate_##T##_pipeline, \
+                .argument = &work[i], \
+                .name = "populate " #T " pipeline create info", \
+            }; \
             vk_pipelines[i] = VK_NULL_HANDLE; \
         } \
         /* populate the Vk*PipelineCreateInfo's for all assembly */ \
@@ -147,7 +147,8 @@ static FN_LAKE_INTERFACE_IMPL(sorceress, lungs)
 
 s32 LAKECALL lake_main(lake_bedrock *bedrock)
 {
-    bedrock->hints.fiber_stack_size = 128*1024;
+    /* the pipeline stages run on large stacks, the rest of the work fits in the default */
+    bedrock->hints.fiber_stack_size_large = 128*1024;
     bedrock->hints.frames_in_flight = 3;
     bedrock->engine_name = "sorceress";
     bedrock->app_name = "Lake in the Lungs";
@@ -38,7 +38,7 @@ FN_LAKE_BEDROCK_MAIN(sorceress_bedrock_main, PFN_lake_interface_impl impl)
          * instances of itself at a time. With a chain the stages can be synchronized by a context 
          * switch instead of busy-waiting for the stage to finish, then the thread will yield back 
          * to the job system and help with remaining work, before safely continuing the gameloop. */
-        lake_work_chain work_chains[PIPELINE_STAGE_COUNT] = { nullptr, nullptr, nullptr };
+        lake_work_chain work_chains[PIPELINE_STAGE_COUNT] = { 0, 0, 0 };
 
         /* Job details per pipeline stage. They will run asynchronously, the responsibility 
          * of the gameloop is to keep them synchronized and to wait for them to end whenever
@@ -48,14 +48,17 @@ FN_LAKE_BEDROCK_MAIN(sorceress_bedrock_main, PFN_lake_interface_impl impl)
         work_details[PIPELINE_GAMEPLAY_STAGE_IDX] = (lake_work_details){
             .procedure = (PFN_lake_work)sorceress.interface->stage_gameplay,
             .name = "sorceress::gameplay",
+            .stack = lake_fiber_stack_large,
         };
         work_details[PIPELINE_RENDERING_STAGE_IDX] = (lake_work_details){
             .procedure = (PFN_lake_work)sorceress.interface->stage_rendering,
             .name = "sorceress::rendering",
+            .stack = lake_fiber_stack_large,
         };
         work_details[PIPELINE_GPUEXEC_STAGE_IDX] = (lake_work_details){
             .procedure = (PFN_lake_work)sorceress.interface->stage_gpuexec,
             .name = "sorceress::gpuexec",
+            .stack = lake_fiber_stack_large,
         };
         /* Holds per-frame work that will be fed forward between pipeline stages. We can assume 
          * every stage to safely run in parallel whenever they run on an unique instance of work. 
@@ -90,14 +93,14 @@ FN_LAKE_BEDROCK_MAIN(sorceress_bedrock_main, PFN_lake_interface_impl impl)
             work->argument = stage.v; \
             if (resolve.v) { \
                 lake_yield(*chain); \
-                *chain = nullptr; \
+                *chain = 0; \
                 control |= resolve.header->control; \
                 __VA_ARGS__ \
             } if (stage.v)
 
             /* GPUEXEC     timeline N-2 */
             RUN_PIPELINE_STAGE(gpuexec, PIPELINE_GPUEXEC_STAGE_IDX, sorceress.interface->end_of_pipe(resolve.impl); )
-                { lake_submit_work(1, work, chain); }
+                { lake_submit_work_priority(lake_work_priority_high, 1, work, chain); }
 
             /* RENDERING   timeline N-1 */
             RUN_PIPELINE_STAGE(rendering, PIPELINE_RENDERING_STAGE_IDX)
@@ -125,13 +128,13 @@ FN_LAKE_BEDROCK_MAIN(sorceress_bedrock_main, PFN_lake_interface_impl impl)
         for (u32 i = 0; i < PIPELINE_STAGE_COUNT; i++) { 
             lake_work_chain chain = work_chains[i];
 
-            if (chain != nullptr) {
+            if (chain != 0) {
                 sorceress_work resolve = { .v = work_details[i].argument };
                 lake_yield(work_chains[i]); 
                 control |= resolve.header->control;
                 sorceress.interface->end_of_pipe(resolve.impl);
             }
-            work_chains[i] = nullptr;
+            work_chains[i] = 0;
         }
         sorceress.interface->release_work(work_count, work_impl);
         lake_drift_pop();
@@ -1,7 +1,88 @@
 #include "../test_framework.h"
 
+#if defined(LAKE_PLATFORM_UNIX)
+#include <unistd.h>
+
+#define ASYNC_BLOCK_SIZE 4096
+
+struct async_block {
+    s32         fd;
+    u32         idx;
+    atomic_u32 *failures;
+};
+
+static FN_LAKE_WORK(async_block_write, struct async_block *block)
+{
+    u8 data[ASYNC_BLOCK_SIZE];
+    lake_memset(data, (s32)block->idx, sizeof(data));
+    if (lake_fs_write_async(block->fd, data, sizeof(data), (u64)block->idx * sizeof(data)) != sizeof(data))
+        lake_atomic_add_explicit(block->failures, 1u, lake_memory_model_relaxed);
+}
+
+static FN_LAKE_WORK(async_block_read, struct async_block *block)
+{
+    u8 data[ASYNC_BLOCK_SIZE];
+    if (lake_fs_read_async(block->fd, data, sizeof(data), (u64)block->idx * sizeof(data)) != sizeof(data)) {
+        lake_atomic_add_explicit(block->failures, 1u, lake_memory_model_relaxed);
+        return;
+    }
+    for (u32 i = 0; i < sizeof(data); i++) {
+        if (data[i] != (u8)block->idx) {
+            lake_atomic_add_explicit(block->failures, 1u, lake_memory_model_relaxed);
+            return;
+        }
+    }
+}
+
+FN_TEST_CASE(Bedrock_file_system, async_read_write, void *)
+{
+    char path[] = "/tmp/lake_fs_async_XXXXXX";
+    s32 const fd = mkstemp(path);
+    if (fd < 0) {
+        test_log_context();
+        test_log("can't create a temporary file");
+        return TEST_RESULT_SKIPPED;
+    }
+    unlink(path);
+
+    atomic_u32 failures;
+    lake_atomic_init(&failures, 0u);
+
+    /* every job writes and reads back it's own block, all of them are in flight at once */
+    struct async_block blocks[64];
+    lake_work_details work[64];
+    for (u32 i = 0; i < lake_arraysize(blocks); i++) {
+        blocks[i] = (struct async_block){ .fd = fd, .idx = i, .failures = &failures };
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)async_block_write,
+            .argument = &blocks[i],
+            .name = "file_system_test::write",
+        };
+    }
+    lake_submit_work_and_yield(lake_arraysize(work), work);
+    for (u32 i = 0; i < lake_arraysize(work); i++)
+        work[i].procedure = (PFN_lake_work)async_block_read;
+    lake_submit_work_and_yield(lake_arraysize(work), work);
+
+    /* reading past the end of file is short, not an error */
+    u8 tail[16];
+    s64 const past_end = lake_fs_read_async(fd, tail, sizeof(tail), lake_arraysize(blocks) * ASYNC_BLOCK_SIZE);
+    close(fd);
+
+    u32 const result = lake_atomic_read_explicit(&failures, lake_memory_model_acquire);
+    if (result != 0 || past_end != 0) {
+        test_log_context();
+        test_log("%u blocks failed to round trip, a read past the end returned %ld", result, past_end);
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+#endif /* LAKE_PLATFORM_UNIX */
+
 static struct test_case_details g_tests[] = {
-    //IMPL_TEST_CASE(Bedrock_file_system, todo),
+#if defined(LAKE_PLATFORM_UNIX)
+    IMPL_TEST_CASE(Bedrock_file_system, async_read_write),
+#endif /* LAKE_PLATFORM_UNIX */
 };
 
 FN_TEST_SUITE_INIT(Bedrock_file_system)
@@ -1,7 +1,683 @@
 #include "../test_framework.h"
+#include "../../source/bedrock/bedrock_impl.h"
+
+static FN_LAKE_WORK(count_work, atomic_u32 *counter)
+{
+    lake_atomic_add_explicit(counter, 1u, lake_memory_model_release);
+}
+
+static FN_LAKE_WORK(fan_out_work, atomic_u32 *counter)
+{
+    lake_work_details work[16];
+    for (u32 i = 0; i < lake_arraysize(work); i++) {
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)count_work,
+            .argument = counter,
+            .name = "job_system_test::count",
+        };
+    }
+    lake_submit_work_and_yield(lake_arraysize(work), work);
+}
+
+FN_TEST_CASE(Bedrock_job_system, nested_submit_and_yield, void *)
+{
+    atomic_u32 counter;
+    lake_atomic_init(&counter, 0u);
+
+    lake_work_details work[64];
+    for (u32 i = 0; i < lake_arraysize(work); i++) {
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)fan_out_work,
+            .argument = &counter,
+            .name = "job_system_test::fan_out",
+        };
+    }
+    lake_submit_work_and_yield(lake_arraysize(work), work);
+
+    u32 const result = lake_atomic_read_explicit(&counter, lake_memory_model_acquire);
+    if (result != 64 * 16) {
+        test_log_context();
+        test_log("expected %u finished jobs, got %u", 64 * 16, result);
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+
+struct ranked_work {
+    atomic_u32 *sequence;
+    u32         rank;
+};
+
+static FN_LAKE_WORK(ranked_work, struct ranked_work *work)
+{
+    work->rank = lake_atomic_add_explicit(work->sequence, 1u, lake_memory_model_relaxed);
+}
+
+/** Keeps a worker busy until the gate opens, it doesn't yield so the worker can't take other work. */
+static FN_LAKE_WORK(hold_work, atomic_u32 *gate)
+{
+    while (!lake_atomic_read_explicit(gate, lake_memory_model_acquire))
+        lake_cpu_relax();
+}
+
+FN_TEST_CASE(Bedrock_job_system, priority_classes, void *)
+{
+    u32 const per_class = 128;
+    atomic_u32 sequence;
+    lake_atomic_init(&sequence, 0u);
+
+    struct ranked_work *ranked = lake_drift_allocate_n(struct ranked_work, per_class * lake_work_priority_count);
+    lake_work_details *work = lake_drift_allocate_n(lake_work_details, per_class * lake_work_priority_count);
+    for (u32 i = 0; i < per_class * lake_work_priority_count; i++) {
+        ranked[i] = (struct ranked_work){ .sequence = &sequence };
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)ranked_work,
+            .argument = &ranked[i],
+            .name = "job_system_test::ranked",
+        };
+    }
+    /* Idle workers would start the background work before the other classes are queued, so 
+     * they are held until all of it is. Workers that finish the jobs of other test cases take 
+     * the spare holder first. One holder more than can run at once stays queued for them. */
+    atomic_u32 gate;
+    lake_atomic_init(&gate, 0u);
+    lake_work_details *holders = lake_drift_allocate_n(lake_work_details, (u32)g_bedrock->thread_count);
+    for (s32 i = 0; i < g_bedrock->thread_count; i++) {
+        holders[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)hold_work,
+            .argument = &gate,
+            .name = "job_system_test::hold",
+        };
+    }
+    lake_work_chain hold_chain;
+    lake_submit_work_priority(lake_work_priority_high, (u32)g_bedrock->thread_count, holders, &hold_chain);
+
+    /* queued from the lowest class up, so a scheduler that ignores priority would start the 
+     * background work first. Workers race for the jobs of a class, so the classes are compared 
+     * by their average start order, not by strict drain order. */
+    lake_work_chain chains[lake_work_priority_count];
+    for (s32 i = lake_work_priority_count - 1; i >= 0; i--)
+        lake_submit_work_priority((lake_work_priority)i, per_class, &work[(u32)i * per_class], &chains[i]);
+    lake_atomic_write_explicit(&gate, 1u, lake_memory_model_release);
+    lake_yield(hold_chain);
+    for (s32 i = 0; i < lake_work_priority_count; i++)
+        lake_yield(chains[i]);
+
+    u64 rank_sums[lake_work_priority_count] = {0};
+    for (u32 i = 0; i < per_class * lake_work_priority_count; i++)
+        rank_sums[i / per_class] += ranked[i].rank;
+    for (s32 i = 1; i < lake_work_priority_count; i++) {
+        if (rank_sums[i - 1] >= rank_sums[i]) {
+            test_log_context();
+            test_log("priority class %d started on average at %lu, not before class %d at %lu", 
+                i - 1, rank_sums[i - 1] / per_class, i, rank_sums[i] / per_class);
+            return TEST_RESULT_FAILED;
+        }
+    }
+    return TEST_RESULT_OKAY;
+}
+
+FN_TEST_CASE(Bedrock_job_system, overflow_past_work_queue, void *)
+{
+    atomic_u32 counter;
+    lake_atomic_init(&counter, 0u);
+
+    /* background work skips the deques, so this is twice the default work queue capacity */
+    static lake_work_details work[4096];
+    for (u32 i = 0; i < lake_arraysize(work); i++) {
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)count_work,
+            .argument = &counter,
+            .name = "job_system_test::count",
+        };
+    }
+    lake_work_chain chain;
+    lake_submit_work_priority(lake_work_priority_background, lake_arraysize(work), work, &chain);
+    lake_yield(chain);
+
+    u32 const result = lake_atomic_read_explicit(&counter, lake_memory_model_acquire);
+    if (result != lake_arraysize(work)) {
+        test_log_context();
+        test_log("expected %u finished jobs, got %u", (u32)lake_arraysize(work), result);
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+
+struct stack_check {
+    lake_fiber_stack    requested;
+    lake_fiber_stack    ran_on;
+    bool                in_bounds;
+    /** If not null, the job waits until this many jobs have started, or the deadline passed. */
+    atomic_u32         *started;
+    u32                 hold_count;
+    u64                 deadline;
+};
+
+static FN_LAKE_WORK(stack_work, struct stack_check *check)
+{
+    /* touch most of a 16KB stack, an overflow would fault on the guard page */
+    u8 volatile scratch[12 * 1024];
+    for (u32 i = 0; i < sizeof(scratch); i += 1024) scratch[i] = (u8)i;
+
+    struct fiber const *fiber = &g_bedrock->fibers[get_thread_local_storage()->fiber_in_use];
+    uptr const lo = (uptr)fiber->stack;
+    uptr const hi = lo + g_bedrock->stack_size[fiber->stack_class];
+    check->in_bounds = (uptr)&scratch[0] >= lo && (uptr)&scratch[sizeof(scratch) - 1] < hi;
+    check->ran_on = fiber->stack_class;
+
+    if (check->started == nullptr) return;
+    lake_atomic_add_explicit(check->started, 1u, lake_memory_model_acq_rel);
+    while (lake_atomic_read_explicit(check->started, lake_memory_model_acquire) < check->hold_count && 
+           lake_time_ns() < check->deadline)
+        lake_yield_until(lake_time_ns() + LAKE_MS_TO_NS(1));
+}
+
+static s32 check_stack_classes(u32 count, struct stack_check const *checks)
+{
+    for (u32 i = 0; i < count; i++) {
+        if (!checks[i].in_bounds) {
+            test_log_context();
+            test_log("job %u ran outside the stack of it's fiber", i);
+            return TEST_RESULT_FAILED;
+        }
+        if (g_bedrock->stack_size[checks[i].ran_on] < g_bedrock->stack_size[checks[i].requested]) {
+            test_log_context();
+            test_log("job %u asked for stack class %d, but ran on a smaller class %d", 
+                i, checks[i].requested, checks[i].ran_on);
+            return TEST_RESULT_FAILED;
+        }
+    }
+    return TEST_RESULT_OKAY;
+}
+
+FN_TEST_CASE(Bedrock_job_system, stack_classes, void *)
+{
+    struct stack_check checks[3 * 64];
+    lake_work_details work[3 * 64];
+    for (u32 i = 0; i < lake_arraysize(work); i++) {
+        checks[i] = (struct stack_check){ .requested = (lake_fiber_stack)(i % lake_fiber_stack_count) };
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)stack_work,
+            .argument = &checks[i],
+            .name = "job_system_test::stack",
+            .stack = checks[i].requested,
+        };
+    }
+    lake_submit_work_and_yield(lake_arraysize(work), work);
+    if (check_stack_classes(lake_arraysize(checks), checks) != TEST_RESULT_OKAY)
+        return TEST_RESULT_FAILED;
+
+    /* hold more small jobs at once than there are small fibers, the rest must fall back */
+    u32 small_count = 0;
+    for (s32 i = 0; i < g_bedrock->fiber_count; i++)
+        small_count += g_bedrock->fibers[i].stack_class == lake_fiber_stack_small;
+    u32 const hold_count = small_count + 8;
+
+    atomic_u32 started;
+    lake_atomic_init(&started, 0u);
+    struct stack_check *held = lake_drift_allocate_n(struct stack_check, hold_count);
+    lake_work_details *held_work = lake_drift_allocate_n(lake_work_details, hold_count);
+    for (u32 i = 0; i < hold_count; i++) {
+        held[i] = (struct stack_check){ 
+            .requested = lake_fiber_stack_small, 
+            .started = &started, 
+            .hold_count = hold_count, 
+            .deadline = lake_time_ns() + LAKE_MS_TO_NS(2000),
+        };
+        held_work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)stack_work,
+            .argument = &held[i],
+            .name = "job_system_test::stack_held",
+            .stack = lake_fiber_stack_small,
+        };
+    }
+    lake_submit_work_and_yield(hold_count, held_work);
+    if (check_stack_classes(hold_count, held) != TEST_RESULT_OKAY)
+        return TEST_RESULT_FAILED;
+
+    u32 const result = lake_atomic_read_explicit(&started, lake_memory_model_acquire);
+    /* a fiber that finished other work may take a job too, as long as it's stack is large enough */
+    u32 fell_back = 0, on_normal = 0;
+    for (u32 i = 0; i < hold_count; i++) {
+        fell_back += held[i].ran_on != lake_fiber_stack_small;
+        on_normal += held[i].ran_on == lake_fiber_stack_normal;
+    }
+    if (result != hold_count || fell_back < hold_count - small_count || on_normal == 0) {
+        test_log_context();
+        test_log("%u of %u small jobs were held at once, %u of them fell back to larger fibers (%u to normal), expected %u", 
+            result, hold_count, fell_back, on_normal, hold_count - small_count);
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+
+static FN_LAKE_WORK(fls_work, atomic_u32 *failures)
+{
+    if (lake_fls_get(0) != nullptr)
+        lake_atomic_add_explicit(failures, 1u, lake_memory_model_relaxed);
+    lake_fls_set(0, (void *)failures);
+
+    /* the slot must survive a yield, even if the job resumes on another thread */
+    atomic_u32 sink;
+    lake_atomic_init(&sink, 0u);
+    lake_work_details work[8];
+    for (u32 i = 0; i < lake_arraysize(work); i++) {
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)fan_out_work,
+            .argument = &sink,
+            .name = "job_system_test::fan_out",
+        };
+    }
+    lake_submit_work_and_yield(lake_arraysize(work), work);
+
+    if (lake_fls_get(0) != (void *)failures)
+        lake_atomic_add_explicit(failures, 1u, lake_memory_model_relaxed);
+}
+
+FN_TEST_CASE(Bedrock_job_system, fiber_local_storage, void *)
+{
+    atomic_u32 failures;
+    lake_atomic_init(&failures, 0u);
+
+    lake_work_details work[32];
+    for (u32 i = 0; i < lake_arraysize(work); i++) {
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)fls_work,
+            .argument = &failures,
+            .name = "job_system_test::fls",
+        };
+    }
+    lake_submit_work_and_yield(lake_arraysize(work), work);
+
+    u32 const result = lake_atomic_read_explicit(&failures, lake_memory_model_acquire);
+    if (result != 0) {
+        test_log_context();
+        test_log("fiber-local storage was lost or leaked %u times", result);
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+
+struct timed_check {
+    u64         deadline;
+    atomic_u32  early;
+};
+
+static FN_LAKE_WORK(timed_work, struct timed_check *check)
+{
+    if (lake_time_ns() < check->deadline)
+        lake_atomic_add_explicit(&check->early, 1u, lake_memory_model_relaxed);
+}
+
+static FN_LAKE_WORK(sleepy_work, struct timed_check *check)
+{
+    lake_yield_until(check->deadline);
+    timed_work(check);
+}
+
+FN_TEST_CASE(Bedrock_job_system, timers, void *)
+{
+    struct timed_check check = { .deadline = lake_time_ns() + LAKE_MS_TO_NS(2) };
+    lake_atomic_init(&check.early, 0u);
+
+    lake_work_details work[16];
+    for (u32 i = 0; i < lake_arraysize(work); i++) {
+        work[i] = (lake_work_details){
+            /* the first half is delayed, the second half sleeps */
+            .procedure = (PFN_lake_work)(i < lake_arraysize(work) / 2 ? timed_work : sleepy_work),
+            .argument = &check,
+            .name = "job_system_test::timed",
+        };
+    }
+    lake_work_chain chain;
+    lake_submit_work_delayed(lake_work_priority_normal, check.deadline, lake_arraysize(work) / 2, work, &chain);
+    lake_submit_work_and_yield(lake_arraysize(work) / 2, &work[lake_arraysize(work) / 2]);
+    lake_yield(chain);
+
+    u32 const result = lake_atomic_read_explicit(&check.early, lake_memory_model_acquire);
+    if (result != 0 || lake_time_ns() < check.deadline) {
+        test_log_context();
+        test_log("%u timed jobs ran before their deadline", result);
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+
+struct pipeline_stage {
+    atomic_u32 *counter;
+    atomic_u32 *failures;
+    u32         expected;
+};
+
+static FN_LAKE_WORK(pipeline_work, struct pipeline_stage *stage)
+{
+    /* every stage must see all the work of the previous stage */
+    if (lake_atomic_read_explicit(stage->counter, lake_memory_model_acquire) < stage->expected)
+        lake_atomic_add_explicit(stage->failures, 1u, lake_memory_model_relaxed);
+    lake_atomic_add_explicit(stage->counter, 1u, lake_memory_model_release);
+}
+
+static FN_LAKE_WORK(gate_work_run, atomic_u32 *gate)
+{
+    while (lake_atomic_read_explicit(gate, lake_memory_model_acquire) == 0)
+        lake_yield_until(lake_time_ns() + LAKE_MS_TO_NS(1));
+}
+
+FN_TEST_CASE(Bedrock_job_system, continuations, void *)
+{
+    atomic_u32 counter, failures;
+    lake_atomic_init(&counter, 0u);
+    lake_atomic_init(&failures, 0u);
+
+    /* fan out, fan in to a single job, then fan out again */
+    u32 const widths[3] = { 16, 1, 16 };
+    struct pipeline_stage stages[3];
+    lake_work_details work[3][16];
+    for (u32 i = 0, expected = 0; i < lake_arraysize(stages); expected += widths[i++]) {
+        stages[i] = (struct pipeline_stage){ .counter = &counter, .failures = &failures, .expected = expected };
+        for (u32 j = 0; j < widths[i]; j++) {
+            work[i][j] = (lake_work_details){
+                .procedure = (PFN_lake_work)pipeline_work,
+                .argument = &stages[i],
+                .name = "job_system_test::pipeline",
+            };
+        }
+    }
+    lake_work_chain chain;
+    lake_submit_work(widths[0], work[0], &chain);
+    lake_submit_work_after(lake_work_priority_high, chain, widths[1], work[1], &chain);
+    lake_submit_work_after(lake_work_priority_background, chain, widths[2], work[2], &chain);
+    lake_yield(chain);
+
+    u32 const result = lake_atomic_read_explicit(&counter, lake_memory_model_acquire);
+    u32 const early = lake_atomic_read_explicit(&failures, lake_memory_model_acquire);
+    if (result != widths[0] + widths[1] + widths[2] || early != 0) {
+        test_log_context();
+        test_log("expected %u finished jobs, got %u, %u of them ran too early", 
+                widths[0] + widths[1] + widths[2], result, early);
+        return TEST_RESULT_FAILED;
+    }
+
+    /* a continuation held back by a gate must keep the priority class it was given */
+    atomic_u32 gate;
+    lake_atomic_init(&gate, 0u);
+    lake_work_details gate_work = {
+        .procedure = (PFN_lake_work)gate_work_run,
+        .argument = &gate,
+        .name = "job_system_test::gate",
+    };
+    lake_work_chain gate_chain;
+    lake_submit_work(1, &gate_work, &gate_chain);
+    lake_submit_work_after(lake_work_priority_background, gate_chain, widths[1], work[1], &chain);
+    lake_work_priority const continued = g_bedrock->chains[(u32)gate_chain - 1u].continuation->priority;
+    lake_atomic_write_explicit(&gate, 1u, lake_memory_model_release);
+    lake_yield(chain);
+    if (continued != lake_work_priority_background) {
+        test_log_context();
+        test_log("a background continuation was queued with priority class %d", continued);
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+
+struct pinned_check {
+    u32         worker_idx;
+    atomic_u32  counter;
+    atomic_u32  failures;
+};
+
+static FN_LAKE_WORK(pinned_work, struct pinned_check *check)
+{
+    if (lake_worker_thread_index() != check->worker_idx)
+        lake_atomic_add_explicit(&check->failures, 1u, lake_memory_model_relaxed);
+
+    /* the nested work may run anywhere, but we must come back to the same worker */
+    lake_work_details work[8];
+    for (u32 i = 0; i < lake_arraysize(work); i++) {
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)fan_out_work,
+            .argument = &check->counter,
+            .name = "job_system_test::fan_out",
+        };
+    }
+    lake_work_chain chain;
+    lake_submit_work(lake_arraysize(work), work, &chain);
+    lake_yield_pinned(chain);
+
+    if (lake_worker_thread_index() != check->worker_idx)
+        lake_atomic_add_explicit(&check->failures, 1u, lake_memory_model_relaxed);
+}
+
+FN_TEST_CASE(Bedrock_job_system, pinned_work, void *)
+{
+    struct pinned_check check = { .worker_idx = 0 };
+    lake_atomic_init(&check.counter, 0u);
+    lake_atomic_init(&check.failures, 0u);
+
+    lake_work_details work[16];
+    for (u32 i = 0; i < lake_arraysize(work); i++) {
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)pinned_work,
+            .argument = &check,
+            .name = "job_system_test::pinned",
+        };
+    }
+    lake_work_chain chain;
+    lake_submit_work_on(check.worker_idx, lake_arraysize(work), work, &chain);
+    lake_yield(chain);
+
+    u32 const result = lake_atomic_read_explicit(&check.counter, lake_memory_model_acquire);
+    u32 const failures = lake_atomic_read_explicit(&check.failures, lake_memory_model_acquire);
+    if (result != 8 * 16 * lake_arraysize(work) || failures != 0) {
+        test_log_context();
+        test_log("expected %u finished jobs, got %u, and %u ran on the wrong worker", 
+                (u32)(8 * 16 * lake_arraysize(work)), result, failures);
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+
+static FN_LAKE_PARALLEL_FOR(mark_range, u8 *marks)
+{
+    for (usize i = begin; i < end; i++) marks[i]++;
+}
+
+static FN_LAKE_PARALLEL_REDUCE(sum_range, u64, void *unused)
+{
+    (void)unused;
+    for (usize i = begin; i < end; i++) *partial += i;
+}
+
+static FN_LAKE_PARALLEL_JOIN(sum_join, u64, void *unused)
+{
+    (void)unused;
+    *left += *right;
+}
+
+/** Larger than `LAKE_PARALLEL_REDUCE_MAX_VALUE_SIZE`, a reduction of it can't split the range. */
+struct lane_sums {
+    u64 lanes[16];
+};
+
+static FN_LAKE_PARALLEL_REDUCE(lane_sum_range, struct lane_sums, void *unused)
+{
+    (void)unused;
+    for (usize i = begin; i < end; i++) partial->lanes[i % 16] += i;
+}
+
+static FN_LAKE_PARALLEL_JOIN(lane_sum_join, struct lane_sums, void *unused)
+{
+    (void)unused;
+    for (u32 i = 0; i < 16; i++) left->lanes[i] += right->lanes[i];
+}
+
+FN_TEST_CASE(Bedrock_job_system, parallel_for_and_reduce, void *)
+{
+    static u8 marks[10007];
+    lake_memset(marks, 0, sizeof(marks));
+
+    lake_parallel_for(0, lake_arraysize(marks), 0, (PFN_lake_parallel_for)mark_range, marks);
+    for (u32 i = 0; i < lake_arraysize(marks); i++) {
+        if (marks[i] != 1) {
+            test_log_context();
+            test_log("index %u was visited %u times", i, marks[i]);
+            return TEST_RESULT_FAILED;
+        }
+    }
+
+    u64 const identity = 0;
+    u64 sum = 0;
+    lake_parallel_reduce(0, lake_arraysize(marks), 64, (PFN_lake_parallel_reduce)sum_range, 
+            (PFN_lake_parallel_join)sum_join, sizeof(u64), &identity, &sum, nullptr);
+
+    u64 const expected = (u64)lake_arraysize(marks) * (lake_arraysize(marks) - 1) / 2;
+    if (sum != expected) {
+        test_log_context();
+        test_log("expected a sum of %lu, got %lu", expected, sum);
+        return TEST_RESULT_FAILED;
+    }
+
+    /* a grain of one splits the range as deep as it goes */
+    lake_parallel_for(0, lake_arraysize(marks), 1, (PFN_lake_parallel_for)mark_range, marks);
+    for (u32 i = 0; i < lake_arraysize(marks); i++) {
+        if (marks[i] != 2) {
+            test_log_context();
+            test_log("index %u was visited %u times with a grain of one", i, marks[i] - 1);
+            return TEST_RESULT_FAILED;
+        }
+    }
+
+    struct lane_sums const lane_identity = {0};
+    struct lane_sums lane_sum;
+    lake_parallel_reduce(0, lake_arraysize(marks), 64, (PFN_lake_parallel_reduce)lane_sum_range, 
+            (PFN_lake_parallel_join)lane_sum_join, sizeof(struct lane_sums), &lane_identity, &lane_sum, nullptr);
+
+    u64 lanes_total = 0;
+    for (u32 i = 0; i < 16; i++) lanes_total += lane_sum.lanes[i];
+    if (lanes_total != expected) {
+        test_log_context();
+        test_log("expected a sum of %lu from %lu byte values, got %lu", expected, sizeof(struct lane_sums), lanes_total);
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+
+static u64 sum_jobs_run(u32 count, lake_worker_stats const *stats)
+{
+    u64 sum = 0;
+    for (u32 i = 0; i < count; i++) sum += stats[i].jobs_run;
+    return sum;
+}
+
+FN_TEST_CASE(Bedrock_job_system, worker_stats, void *)
+{
+    u32 const count = lake_worker_stats_snapshot(0, nullptr);
+    lake_worker_stats *before = lake_drift_allocate_n(lake_worker_stats, count);
+    lake_worker_stats *after = lake_drift_allocate_n(lake_worker_stats, count);
+
+    atomic_u32 counter;
+    lake_atomic_init(&counter, 0u);
+    lake_work_details work[64];
+    for (u32 i = 0; i < lake_arraysize(work); i++) {
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)fan_out_work,
+            .argument = &counter,
+            .name = "job_system_test::fan_out",
+        };
+    }
+    lake_worker_stats_snapshot(count, before);
+    lake_submit_work_and_yield(lake_arraysize(work), work);
+    lake_worker_stats_snapshot(count, after);
+
+    /* other tests may run in the meantime, so the counters can only be checked from below */
+    u64 const jobs_run = sum_jobs_run(count, after) - sum_jobs_run(count, before);
+    if (jobs_run < 64 * 17) {
+        test_log_context();
+        test_log("expected at least %u jobs counted, got %lu", 64 * 17, jobs_run);
+        return TEST_RESULT_FAILED;
+    }
+    for (u32 i = 0; i < count; i++) {
+        if (after[i].fiber_switches < before[i].fiber_switches || after[i].idle_ns < before[i].idle_ns) {
+            test_log_context();
+            test_log("counters of worker %u went backwards", i);
+            return TEST_RESULT_FAILED;
+        }
+    }
+    return TEST_RESULT_OKAY;
+}
+
+FN_TEST_CASE(Bedrock_job_system, cpu_topology_order, void *)
+{
+    /* two packages with their own L3, 4 cores of 2 SMT threads each, siblings enumerated next to 
+     * each other and the packages listed back to front, so the input order is the worst case */
+    struct cpu_topology topology[16];
+    for (s32 i = 0; i < 16; i++) {
+        s32 const cpu = 15 - i;
+        s32 const package = cpu / 8;
+        topology[i] = (struct cpu_topology){ 
+            .cpu = cpu, .core = (cpu % 8) / 2, .package = package, .domain = package * 8, .capacity = 1024 };
+    }
+    cpu_topology_order(topology, 16);
+
+    u32 seen_cpus = 0;
+    u8 seen_cores = 0;
+    s32 cores_used = 0;
+    for (s32 i = 0; i < 16; i++) {
+        struct cpu_topology const *t = &topology[i];
+        u8 const core_bit = (u8)(1u << (t->package * 4 + t->core));
+
+        if (seen_cpus & (1u << t->cpu)) {
+            test_log_context();
+            test_log("CPU %d was placed twice", t->cpu);
+            return TEST_RESULT_FAILED;
+        }
+        seen_cpus |= 1u << t->cpu;
+        if (seen_cores & core_bit) {
+            if (cores_used < 8) {
+                test_log_context();
+                test_log("SMT sibling CPU %d placed at %d, before all 8 physical cores were used", t->cpu, i);
+                return TEST_RESULT_FAILED;
+            }
+        } else {
+            seen_cores |= core_bit;
+            cores_used++;
+        }
+        /* both halves keep a package and it's cache domain together */
+        if (i % 8 != 0 && (t->package < topology[i - 1].package || t->domain < topology[i - 1].domain)) {
+            test_log_context();
+            test_log("CPU %d of package %d placed at %d breaks up the package grouping", t->cpu, t->package, i);
+            return TEST_RESULT_FAILED;
+        }
+    }
+
+    /* without SMT, the faster cores of a hybrid part go first */
+    struct cpu_topology hybrid[4];
+    for (s32 i = 0; i < 4; i++)
+        hybrid[i] = (struct cpu_topology){ .cpu = i, .core = i, .package = 0, .domain = 0, .capacity = i < 2 ? 512 : 1024 };
+    cpu_topology_order(hybrid, 4);
+    for (s32 i = 0; i < 4; i++) {
+        if (hybrid[i].capacity != (i < 2 ? 1024 : 512)) {
+            test_log_context();
+            test_log("CPU %d of capacity %d placed at %d", hybrid[i].cpu, hybrid[i].capacity, i);
+            return TEST_RESULT_FAILED;
+        }
+    }
+    return TEST_RESULT_OKAY;
+}
 
 static struct test_case_details g_tests[] = {
-    //IMPL_TEST_CASE(Bedrock_job_system, todo),
+    IMPL_TEST_CASE(Bedrock_job_system, nested_submit_and_yield),
+    IMPL_TEST_CASE(Bedrock_job_system, priority_classes),
+    IMPL_TEST_CASE(Bedrock_job_system, overflow_past_work_queue),
+    IMPL_TEST_CASE(Bedrock_job_system, fiber_local_storage),
+    IMPL_TEST_CASE(Bedrock_job_system, stack_classes),
+    IMPL_TEST_CASE(Bedrock_job_system, timers),
+    IMPL_TEST_CASE(Bedrock_job_system, continuations),
+    IMPL_TEST_CASE(Bedrock_job_system, pinned_work),
+    IMPL_TEST_CASE(Bedrock_job_system, parallel_for_and_reduce),
+    IMPL_TEST_CASE(Bedrock_job_system, worker_stats),
+    IMPL_TEST_CASE(Bedrock_job_system, cpu_topology_order),
 };
 
 FN_TEST_SUITE_INIT(Bedrock_job_system)
@@ -1,7 +1,105 @@
 #include "../test_framework.h"
 
+struct allocation {
+    u8     *memory;
+    usize   size;
+};
+
+FN_TEST_CASE(Bedrock_machina, size_classes, void *)
+{
+    static usize const sizes[] = { 1, 8, 16, 17, 48, 64, 65, 100, 200, 256, 1000, 2048, 2049, 65536 };
+    static usize const aligns[] = { 1, 8, 16, 64, 128, 256, 512 };
+
+    for (u32 i = 0; i < lake_arraysize(sizes); i++) {
+        for (u32 j = 0; j < lake_arraysize(aligns); j++) {
+            u8 *memory = (u8 *)__lake_malloc(sizes[i], aligns[j]);
+            if (memory == nullptr || ((uptr)memory & (aligns[j] - 1))) {
+                test_log_context();
+                test_log("allocation of %lu bytes aligned to %lu returned %p", sizes[i], aligns[j], memory);
+                return TEST_RESULT_FAILED;
+            }
+            lake_memset(memory, 0xab, sizes[i]);
+
+            /* growing past the size class must keep the contents */
+            u8 *grown = (u8 *)__lake_realloc(memory, 2 * sizes[i] + 1, aligns[j]);
+            for (usize k = 0; grown && k < sizes[i]; k++) {
+                if (grown[k] != 0xab) {
+                    test_log_context();
+                    test_log("reallocation of %lu bytes lost the contents at %lu", sizes[i], k);
+                    return TEST_RESULT_FAILED;
+                }
+            }
+            __lake_free(grown);
+        }
+    }
+    return TEST_RESULT_OKAY;
+}
+
+#define REMOTE_ALLOCATION_COUNT 512
+
+static FN_LAKE_WORK(allocate_work, struct allocation *allocations)
+{
+    for (u32 i = 0; i < REMOTE_ALLOCATION_COUNT; i++) {
+        usize const size = 16 + (i * 37) % 1024;
+        allocations[i].memory = (u8 *)__lake_malloc(size, 16);
+        allocations[i].size = size;
+        if (allocations[i].memory) lake_memset(allocations[i].memory, (u8)i, size);
+    }
+}
+
+static FN_LAKE_WORK(free_work, struct allocation *allocations)
+{
+    for (u32 i = 0; i < REMOTE_ALLOCATION_COUNT; i++)
+        __lake_free(allocations[i].memory);
+}
+
+FN_TEST_CASE(Bedrock_machina, remote_free, void *)
+{
+    struct allocation *allocations = lake_drift_allocate_n(struct allocation, 8 * REMOTE_ALLOCATION_COUNT);
+
+    lake_work_details work[8];
+    for (u32 round = 0; round < 4; round++) {
+        for (u32 i = 0; i < lake_arraysize(work); i++) {
+            work[i] = (lake_work_details){
+                .procedure = (PFN_lake_work)allocate_work,
+                .argument = &allocations[i * REMOTE_ALLOCATION_COUNT],
+                .name = "machina_test::allocate",
+            };
+        }
+        lake_submit_work_and_yield(lake_arraysize(work), work);
+
+        for (u32 i = 0; i < 8 * REMOTE_ALLOCATION_COUNT; i++) {
+            struct allocation const *a = &allocations[i];
+            for (usize k = 0; a->memory && k < a->size; k++) {
+                if (a->memory[k] != (u8)(i % REMOTE_ALLOCATION_COUNT)) {
+                    test_log_context();
+                    test_log("allocation %u of %lu bytes was overwritten at %lu", i, a->size, k);
+                    return TEST_RESULT_FAILED;
+                }
+            }
+            if (a->memory == nullptr) {
+                test_log_context();
+                test_log("allocation %u of %lu bytes failed", i, a->size);
+                return TEST_RESULT_FAILED;
+            }
+        }
+
+        /* every job frees the allocations of another job, likely made by another worker */
+        for (u32 i = 0; i < lake_arraysize(work); i++) {
+            work[i] = (lake_work_details){
+                .procedure = (PFN_lake_work)free_work,
+                .argument = &allocations[((i + 1) % lake_arraysize(work)) * REMOTE_ALLOCATION_COUNT],
+                .name = "machina_test::free",
+            };
+        }
+        lake_submit_work_and_yield(lake_arraysize(work), work);
+    }
+    return TEST_RESULT_OKAY;
+}
+
 static struct test_case_details g_tests[] = {
-    //IMPL_TEST_CASE(Bedrock_machina, todo),
+    IMPL_TEST_CASE(Bedrock_machina, size_classes),
+    IMPL_TEST_CASE(Bedrock_machina, remote_free),
 };
 
 FN_TEST_SUITE_INIT(Bedrock_machina)
@@ -1,7 +1,244 @@
 #include "../test_framework.h"
+#include "../../source/bedrock/bedrock_impl.h"
+
+#define CACHE_TEST_TAG          0x7e57
+#define CACHE_JOB_COUNT         8
+#define CACHE_ALLOCATION_COUNT  2048
+
+struct thalloc_span {
+    u8     *memory;
+    usize   size;
+};
+
+static FN_LAKE_WORK(thalloc_work, struct thalloc_span *spans)
+{
+    for (u32 i = 0; i < CACHE_ALLOCATION_COUNT; i++) {
+        usize const size = 16 + (i * 97) % 2048;
+        spans[i].memory = (u8 *)lake_thalloc(CACHE_TEST_TAG, size, 1lu << (i % 7));
+        spans[i].size = size;
+        if (spans[i].memory) lake_memset(spans[i].memory, (u8)i, size);
+    }
+}
+
+FN_TEST_CASE(Bedrock_tagged_heap, worker_caches, void *)
+{
+    struct thalloc_span *spans = lake_drift_allocate_n(struct thalloc_span, CACHE_JOB_COUNT * CACHE_ALLOCATION_COUNT);
+    lake_work_details work[CACHE_JOB_COUNT];
+
+    /* every round frees the tag, the caches must not hand out blocks of the last lifetime */
+    for (u32 round = 0; round < 3; round++) {
+        for (u32 i = 0; i < CACHE_JOB_COUNT; i++) {
+            work[i] = (lake_work_details){
+                .procedure = (PFN_lake_work)thalloc_work,
+                .argument = &spans[i * CACHE_ALLOCATION_COUNT],
+                .name = "tagged_heap_test::thalloc",
+            };
+        }
+        lake_submit_work_and_yield(CACHE_JOB_COUNT, work);
+
+        /* larger allocations take the shared path under the same tag */
+        u8 *large = (u8 *)lake_thalloc(CACHE_TEST_TAG, LAKE_TAGGED_HEAP_BLOCK_SIZE, 16);
+        if (large == nullptr) {
+            test_log_context();
+            test_log("a shared allocation of %lu bytes failed", LAKE_TAGGED_HEAP_BLOCK_SIZE);
+            return TEST_RESULT_FAILED;
+        }
+        lake_memset(large, 0xcc, LAKE_TAGGED_HEAP_BLOCK_SIZE);
+
+        for (u32 i = 0; i < CACHE_JOB_COUNT * CACHE_ALLOCATION_COUNT; i++) {
+            struct thalloc_span const *span = &spans[i];
+            u32 const k = i % CACHE_ALLOCATION_COUNT;
+
+            if (span->memory == nullptr || ((uptr)span->memory & ((1lu << (k % 7)) - 1))) {
+                test_log_context();
+                test_log("allocation %u of %lu bytes failed or is misaligned", i, span->size);
+                return TEST_RESULT_FAILED;
+            }
+            for (usize j = 0; j < span->size; j++) {
+                if (span->memory[j] != (u8)k) {
+                    test_log_context();
+                    test_log("allocation %u of %lu bytes was overwritten at %lu", i, span->size, j);
+                    return TEST_RESULT_FAILED;
+                }
+            }
+        }
+        lake_thfree(CACHE_TEST_TAG);
+    }
+    return TEST_RESULT_OKAY;
+}
+
+/** Ranges of blocks in different sizes, the last one spans more than a word of the bitmap. 
+ *  Test cases run at the same time, so every case frees only a tag of it's own. */
+#define RANGE_TEST_TAG          0x7e58
+FN_TEST_CASE(Bedrock_tagged_heap, block_ranges, void *)
+{
+    static usize const block_counts[] = { 2, 3, 5, 8, 13, 66 };
+    lake_thblock_range ranges[lake_arraysize(block_counts)];
+
+    /* the second round takes the ranges freed by the first */
+    for (u32 round = 0; round < 2; round++) {
+        for (u32 i = 0; i < lake_arraysize(block_counts); i++) {
+            ranges[i] = lake_thblock(RANGE_TEST_TAG, block_counts[i] * LAKE_TAGGED_HEAP_BLOCK_SIZE);
+            if (ranges[i].memory == nullptr) {
+                test_log_context();
+                test_log("a range of %lu blocks failed", block_counts[i]);
+                return TEST_RESULT_FAILED;
+            }
+            /* touching every block is enough to find an overlap */
+            for (usize b = 0; b < block_counts[i]; b++)
+                ((u8 *)ranges[i].memory)[b * LAKE_TAGGED_HEAP_BLOCK_SIZE] = (u8)i;
+        }
+        for (u32 i = 0; i < lake_arraysize(block_counts); i++) {
+            for (usize b = 0; b < block_counts[i]; b++) {
+                if (((u8 *)ranges[i].memory)[b * LAKE_TAGGED_HEAP_BLOCK_SIZE] != (u8)i) {
+                    test_log_context();
+                    test_log("block %lu of range %u was overwritten", b, i);
+                    return TEST_RESULT_FAILED;
+                }
+            }
+        }
+        lake_thfree(RANGE_TEST_TAG);
+    }
+    return TEST_RESULT_OKAY;
+}
+
+/** Many short-lived tags, every job keeps more tags alive at once than a worker caches, 
+ *  so most allocations look their heap up again while older tags are being freed. */
+#define CHURN_TEST_TAG          0x10000
+#define CHURN_JOB_COUNT         4
+#define CHURN_TAG_COUNT         256
+#define CHURN_ALIVE_COUNT       5
+
+struct tag_churn {
+    u32     job;
+    u32     done;
+};
+
+static FN_LAKE_WORK(tag_churn_work, struct tag_churn *churn)
+{
+    u32 *first[CHURN_ALIVE_COUNT] = {0};
+    for (u32 i = 0; i < CHURN_TAG_COUNT; i++) {
+        lake_heap_tag const tag = CHURN_TEST_TAG + churn->job * CHURN_TAG_COUNT + i;
+        u32 const slot = i % CHURN_ALIVE_COUNT;
+
+        /* the oldest tag alive must still hold it's value */
+        if (i >= CHURN_ALIVE_COUNT) {
+            if (*first[slot] != tag - CHURN_ALIVE_COUNT) return;
+            lake_thfree(tag - CHURN_ALIVE_COUNT);
+        }
+        first[slot] = lake_thalloc_t(tag, u32);
+        if (first[slot] == nullptr) return;
+        *first[slot] = tag;
+
+        /* a tag found under a new heap would leak the old one, until none are left */
+        for (u32 j = 0; j < CHURN_ALIVE_COUNT && j <= i; j++) {
+            u32 *memory = lake_thalloc_t(tag - j, u32);
+            if (memory == nullptr) return;
+            *memory = tag - j;
+        }
+        churn->done++;
+    }
+    for (u32 i = CHURN_TAG_COUNT - CHURN_ALIVE_COUNT; i < CHURN_TAG_COUNT; i++)
+        lake_thfree(CHURN_TEST_TAG + churn->job * CHURN_TAG_COUNT + i);
+}
+
+FN_TEST_CASE(Bedrock_tagged_heap, tag_churn, void *)
+{
+    struct tag_churn churn[CHURN_JOB_COUNT];
+    lake_work_details work[CHURN_JOB_COUNT];
+    for (u32 i = 0; i < CHURN_JOB_COUNT; i++) {
+        churn[i] = (struct tag_churn){ .job = i };
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)tag_churn_work,
+            .argument = &churn[i],
+            .name = "tagged_heap_test::tag_churn",
+        };
+    }
+    lake_submit_work_and_yield(CHURN_JOB_COUNT, work);
+
+    for (u32 i = 0; i < CHURN_JOB_COUNT; i++) {
+        if (churn[i].done != CHURN_TAG_COUNT) {
+            test_log_context();
+            test_log("job %u lost a tag after %u of %u tags", i, churn[i].done, CHURN_TAG_COUNT);
+            return TEST_RESULT_FAILED;
+        }
+    }
+    return TEST_RESULT_OKAY;
+}
+
+/** A worker that cycles through more tags than it caches evicts an entry on every lookup. 
+ *  The evicted blocks go back to their heap, so every tag keeps using it's first block. */
+#define EVICT_TEST_TAG          0x7e70
+#define EVICT_TAG_COUNT         (TAGGED_HEAP_CACHE_TAGS + 2)
+#define EVICT_ROUND_COUNT       16
+#define EVICT_ALLOCATION_SIZE   256
+
+struct evict_check {
+    u8     *memory[EVICT_TAG_COUNT][EVICT_ROUND_COUNT];
+};
+
+static FN_LAKE_WORK(evict_work, struct evict_check *check)
+{
+    for (u32 round = 0; round < EVICT_ROUND_COUNT; round++) {
+        for (u32 i = 0; i < EVICT_TAG_COUNT; i++) {
+            u8 *memory = (u8 *)lake_thalloc(EVICT_TEST_TAG + i, EVICT_ALLOCATION_SIZE, 16);
+            if (memory) lake_memset(memory, (u8)(round * EVICT_TAG_COUNT + i), EVICT_ALLOCATION_SIZE);
+            check->memory[i][round] = memory;
+        }
+    }
+}
+
+FN_TEST_CASE(Bedrock_tagged_heap, evicted_entries, void *)
+{
+    struct evict_check *check = lake_drift_allocate_t(struct evict_check);
+    lake_work_details work = {
+        .procedure = (PFN_lake_work)evict_work,
+        .argument = check,
+        .name = "tagged_heap_test::evicted_entries",
+    };
+    lake_submit_work_and_yield(1, &work);
+
+    s32 result = TEST_RESULT_OKAY;
+    for (u32 i = 0; i < EVICT_TAG_COUNT && result == TEST_RESULT_OKAY; i++) {
+        usize const first_block = (usize)(check->memory[i][0] - (u8 *)g_bedrock) / LAKE_TAGGED_HEAP_BLOCK_SIZE;
+
+        for (u32 round = 0; round < EVICT_ROUND_COUNT; round++) {
+            u8 const *memory = check->memory[i][round];
+            if (memory == nullptr) {
+                test_log_context();
+                test_log("allocation %u of tag %u failed", round, i);
+                result = TEST_RESULT_FAILED;
+                break;
+            }
+            usize const block = (usize)(memory - (u8 *)g_bedrock) / LAKE_TAGGED_HEAP_BLOCK_SIZE;
+            if (block != first_block) {
+                test_log_context();
+                test_log("allocation %u of tag %u took block %lu, the first one took block %lu", round, i, block, first_block);
+                result = TEST_RESULT_FAILED;
+                break;
+            }
+            u8 const expected = (u8)(round * EVICT_TAG_COUNT + i);
+            for (usize j = 0; j < EVICT_ALLOCATION_SIZE; j++) {
+                if (memory[j] != expected) {
+                    test_log_context();
+                    test_log("allocation %u of tag %u was overwritten at %lu", round, i, j);
+                    result = TEST_RESULT_FAILED;
+                    break;
+                }
+            }
+            if (result != TEST_RESULT_OKAY) break;
+        }
+    }
+    for (u32 i = 0; i < EVICT_TAG_COUNT; i++)
+        lake_thfree(EVICT_TEST_TAG + i);
+    return result;
+}
 
 static struct test_case_details g_tests[] = {
-    //IMPL_TEST_CASE(Bedrock_tagged_heap, todo),
+    IMPL_TEST_CASE(Bedrock_tagged_heap, worker_caches),
+    IMPL_TEST_CASE(Bedrock_tagged_heap, block_ranges),
+    IMPL_TEST_CASE(Bedrock_tagged_heap, tag_churn),
+    IMPL_TEST_CASE(Bedrock_tagged_heap, evicted_entries),
 };
 
 FN_TEST_SUITE_INIT(Bedrock_tagged_heap)
@@ -18,3 +255,202 @@ FN_TEST_SUITE_FINI(Bedrock_tagged_heap)
 {
     (void)userdata;
 }
+
+/** Trimming runs in a suite of it's own, so no other test case takes the freed blocks meanwhile. */
+#define TRIM_TEST_TAG           0x7e5a
+#define TRIM_BLOCK_COUNT        8
+
+/** A purged block reads back zeroes, a block that kept it's pages still holds it's value. */
+static u8 *trim_block(lake_thblock_range range, usize b)
+{
+    return (u8 *)range.memory + b * LAKE_TAGGED_HEAP_BLOCK_SIZE;
+}
+
+static s32 trim_idle_blocks(void)
+{
+    lake_thblock_range range = lake_thblock(TRIM_TEST_TAG, TRIM_BLOCK_COUNT * LAKE_TAGGED_HEAP_BLOCK_SIZE);
+    if (range.memory == nullptr) {
+        test_log_context();
+        test_log("a range of %u blocks failed", TRIM_BLOCK_COUNT);
+        return TEST_RESULT_FAILED;
+    }
+    for (usize b = 0; b < TRIM_BLOCK_COUNT; b++)
+        lake_memset(trim_block(range, b), 0xa0 + (u8)b, LAKE_TAGGED_HEAP_BLOCK_SIZE);
+    lake_thfree(TRIM_TEST_TAG);
+
+    /* the first pass sees the blocks free, with a high water mark of 0 the next one purges them */
+    lake_thtrim(0);
+
+    /* take blocks until one of the range is retired again, lower free blocks come first */
+    u8 *retired = nullptr;
+    for (u32 i = 0; i < 64 && retired == nullptr; i++) {
+        u8 *block = (u8 *)lake_thblock(TRIM_TEST_TAG, LAKE_TAGGED_HEAP_BLOCK_SIZE).memory;
+        if (block == nullptr) break;
+        if (block >= trim_block(range, 0) && block < trim_block(range, TRIM_BLOCK_COUNT))
+            retired = block;
+        lake_memset(block, 0x5e, LAKE_TAGGED_HEAP_BLOCK_SIZE);
+    }
+    lake_thfree(TRIM_TEST_TAG);
+    if (retired == nullptr) {
+        test_log_context();
+        test_log("no block of the freed range was taken again");
+        return TEST_RESULT_FAILED;
+    }
+
+    if (lake_thtrim(0) == 0) {
+        test_log_context();
+        test_log("the host can't purge pages of free blocks");
+        return TEST_RESULT_SKIPPED;
+    }
+    for (usize b = 0; b < TRIM_BLOCK_COUNT; b++) {
+        u8 const *block = trim_block(range, b);
+        u8 const expected = block == retired ? 0x5e : 0;
+        if (block[0] != expected || block[LAKE_TAGGED_HEAP_BLOCK_SIZE - 1] != expected) {
+            test_log_context();
+            test_log("block %lu of the range holds %#x after two passes, expected %#x", b, block[0], expected);
+            return TEST_RESULT_FAILED;
+        }
+    }
+
+    /* purged blocks fault their pages in again, released ones are committed again */
+    lake_thadvise(LAKE_TAGGED_HEAP_BLOCK_SIZE, lake_thadvise_release | lake_thadvise_suboptimal);
+    range = lake_thblock(TRIM_TEST_TAG, TRIM_BLOCK_COUNT * LAKE_TAGGED_HEAP_BLOCK_SIZE);
+    if (range.memory == nullptr) {
+        test_log_context();
+        test_log("a range of %u blocks failed after the trim", TRIM_BLOCK_COUNT);
+        return TEST_RESULT_FAILED;
+    }
+    for (usize b = 0; b < TRIM_BLOCK_COUNT; b++)
+        lake_memset(trim_block(range, b), 0xb0 + (u8)b, LAKE_TAGGED_HEAP_BLOCK_SIZE);
+    for (usize b = 0; b < TRIM_BLOCK_COUNT; b++) {
+        u8 const *block = trim_block(range, b);
+        for (usize j = 0; j < LAKE_TAGGED_HEAP_BLOCK_SIZE; j += 4096) {
+            if (block[j] != 0xb0 + (u8)b) {
+                test_log_context();
+                test_log("block %lu was overwritten at %lu after the trim", b, j);
+                return TEST_RESULT_FAILED;
+            }
+        }
+    }
+    lake_thfree(TRIM_TEST_TAG);
+    return TEST_RESULT_OKAY;
+}
+
+/** Set once `idle_blocks` is done, the other cases of the suite would take it's blocks. */
+static atomic_u32 g_trim_idle_done;
+
+FN_TEST_CASE(Bedrock_tagged_heap_trim, idle_blocks, void *)
+{
+    s32 const result = trim_idle_blocks();
+    lake_atomic_write_explicit(&g_trim_idle_done, 1u, lake_memory_model_release);
+    return result;
+}
+
+#define RELEASE_TEST_TAG        0x7e60
+#define RELEASE_WORKER_COUNT    8
+#define RELEASE_ROUND_COUNT     128
+#define RELEASE_BLOCK_COUNT     8
+
+struct release_check {
+    atomic_u32     *allocators_done;
+    atomic_u32      next_tag;
+    atomic_u32      failures;
+};
+
+/** Takes and writes whole blocks, one tag per job, while the top of the commitment is released. 
+ *  Free blocks are taken from the bottom, so enough of them are held to reach up to the top. */
+static FN_LAKE_WORK(allocate_while_release, struct release_check *check)
+{
+    lake_heap_tag const tag = RELEASE_TEST_TAG + lake_atomic_add_explicit(&check->next_tag, 1u, lake_memory_model_relaxed);
+    u8 *blocks[RELEASE_BLOCK_COUNT];
+
+    for (u32 round = 0; round < RELEASE_ROUND_COUNT; round++) {
+        for (u32 i = 0; i < RELEASE_BLOCK_COUNT; i++) {
+            /* too large for the worker caches, every allocation takes a block of it's own */
+            blocks[i] = (u8 *)lake_thalloc(tag, LAKE_TAGGED_HEAP_BLOCK_SIZE, LAKE_TAGGED_HEAP_BLOCK_SIZE);
+            if (blocks[i] == nullptr) {
+                lake_atomic_add_explicit(&check->failures, 1u, lake_memory_model_relaxed);
+                lake_thfree(tag);
+                lake_atomic_add_explicit(check->allocators_done, 1u, lake_memory_model_release);
+                return;
+            }
+            /* a block released under us would fault right here */
+            for (usize j = 0; j < LAKE_TAGGED_HEAP_BLOCK_SIZE; j += 4096) blocks[i][j] = (u8)(round + i);
+        }
+        for (u32 i = 0; i < RELEASE_BLOCK_COUNT; i++) {
+            for (usize j = 0; j < LAKE_TAGGED_HEAP_BLOCK_SIZE; j += 4096) {
+                if (blocks[i][j] != (u8)(round + i)) {
+                    lake_atomic_add_explicit(&check->failures, 1u, lake_memory_model_relaxed);
+                    break;
+                }
+            }
+        }
+        lake_thfree(tag);
+    }
+    lake_atomic_add_explicit(check->allocators_done, 1u, lake_memory_model_release);
+}
+
+static FN_LAKE_WORK(release_while_allocate, struct release_check *check)
+{
+    while (lake_atomic_read_explicit(check->allocators_done, lake_memory_model_acquire) < RELEASE_WORKER_COUNT) {
+        lake_thadvise(LAKE_TAGGED_HEAP_BLOCK_SIZE, lake_thadvise_release);
+        lake_yield_until(lake_time_ns() + LAKE_US_TO_NS(1));
+    }
+}
+
+FN_TEST_CASE(Bedrock_tagged_heap_trim, release_while_allocating, void *)
+{
+    /* wait for `idle_blocks`, with a limit, so a failure there can't hang this case */
+    u64 const deadline = lake_time_ns() + LAKE_MS_TO_NS(10000);
+    while (!lake_atomic_read_explicit(&g_trim_idle_done, lake_memory_model_acquire) && lake_time_ns() < deadline)
+        lake_yield_until(lake_time_ns() + LAKE_MS_TO_NS(1));
+
+    atomic_u32 allocators_done;
+    lake_atomic_init(&allocators_done, 0u);
+    struct release_check check = { .allocators_done = &allocators_done };
+    lake_atomic_init(&check.next_tag, 0u);
+    lake_atomic_init(&check.failures, 0u);
+
+    lake_work_details work[RELEASE_WORKER_COUNT + 1];
+    for (u32 i = 0; i < RELEASE_WORKER_COUNT; i++) {
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)allocate_while_release,
+            .argument = &check,
+            .name = "tagged_heap_test::allocate_while_release",
+        };
+    }
+    work[RELEASE_WORKER_COUNT] = (lake_work_details){
+        .procedure = (PFN_lake_work)release_while_allocate,
+        .argument = &check,
+        .name = "tagged_heap_test::release_while_allocate",
+    };
+    lake_submit_work_and_yield(lake_arraysize(work), work);
+
+    u32 const failures = lake_atomic_read_explicit(&check.failures, lake_memory_model_acquire);
+    if (failures != 0) {
+        test_log_context();
+        test_log("%u blocks failed or were overwritten while the commitment was released", failures);
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+
+static struct test_case_details g_trim_tests[] = {
+    IMPL_TEST_CASE(Bedrock_tagged_heap_trim, idle_blocks),
+    IMPL_TEST_CASE(Bedrock_tagged_heap_trim, release_while_allocating),
+};
+
+FN_TEST_SUITE_INIT(Bedrock_tagged_heap_trim)
+{
+    *out = (struct test_suite_details){
+        .count = lake_arraysize(g_trim_tests),
+        .tests = g_trim_tests,
+        .userdata = nullptr,
+    };
+    (void)bedrock;
+}
+
+FN_TEST_SUITE_FINI(Bedrock_tagged_heap_trim)
+{
+    (void)userdata;
+}
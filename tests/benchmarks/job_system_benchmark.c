@@ -0,0 +1,246 @@
+#define LAKE_IN_THE_LUNGS_MAIN
+#include <lake/inthelungs.h>
+#include <stdio.h>
+
+/* the raw context switch is measured through the private entry points in assembly */
+#include "../../source/bedrock/bedrock_impl.h"
+
+/* Microbenchmarks of the job system. The bedrock is set up again for every worker count, from
+ * one worker up to the count given as the first argument (at most, and by default, every CPU of
+ * the host), in powers of two. Every benchmark runs a few rounds, results are printed to stdout as one
+ * JSON object per line, so they can be collected for regression tracking:
+ *
+ *  {"benchmark":"submit_empty","workers":4,"ops":65536,"rounds":5,"best_ns_per_op":..,"mean_ns_per_op":..}
+ */
+
+#define BENCH_ROUNDS 5
+
+struct bench_result {
+    u64 ops;
+    u64 best_ns;
+    u64 total_ns;
+};
+
+static u32 g_worker_count = 0;
+
+static void bench_report(char const *name, struct bench_result const *result)
+{
+    f64 const ops = (f64)result->ops;
+    printf("{\"benchmark\":\"%s\",\"workers\":%u,\"ops\":%lu,\"rounds\":%u,"
+           "\"best_ns_per_op\":%.3f,\"mean_ns_per_op\":%.3f}\n",
+           name, g_worker_count, result->ops, BENCH_ROUNDS,
+           (f64)result->best_ns / ops, (f64)result->total_ns / (ops * BENCH_ROUNDS));
+    fflush(stdout);
+}
+
+#define BENCH_RUN(NAME, OPS, ...) do { \
+        struct bench_result result = { .ops = (OPS), .best_ns = UINT64_MAX, .total_ns = 0 }; \
+        for (u32 round = 0; round < BENCH_ROUNDS; round++) { \
+            u64 const time_start = lake_time_ns(); \
+            __VA_ARGS__; \
+            u64 const dt = lake_time_ns() - time_start; \
+            result.best_ns = lake_min(result.best_ns, dt); \
+            result.total_ns += dt; \
+        } \
+        bench_report(NAME, &result); \
+    } while (0)
+
+static FN_LAKE_WORK(empty_work, void *unused)
+{
+    (void)unused;
+}
+
+/** Submit to completion throughput of jobs that do nothing, in batches that are waited for. */
+#define SUBMIT_BATCH_SIZE   1024
+#define SUBMIT_BATCH_COUNT  64
+static void bench_submit_empty(void)
+{
+    static lake_work_details work[SUBMIT_BATCH_SIZE];
+    for (u32 i = 0; i < SUBMIT_BATCH_SIZE; i++)
+        work[i] = (lake_work_details){ .procedure = empty_work, .name = "bench::empty" };
+
+    BENCH_RUN("submit_empty", SUBMIT_BATCH_SIZE * SUBMIT_BATCH_COUNT,
+        for (u32 batch = 0; batch < SUBMIT_BATCH_COUNT; batch++)
+            lake_submit_work_and_yield(SUBMIT_BATCH_SIZE, work));
+}
+
+/** Latency of a single `jump_fcontext`, two contexts of this thread switch back and forth. */
+#define SWITCH_COUNT 1000000
+static fcontext g_switch_home;
+static fcontext g_switch_other;
+
+static void switch_loop(sptr preserve_fpu)
+{
+    for (;;) jump_fcontext(&g_switch_other, g_switch_home, preserve_fpu, (s32)preserve_fpu);
+}
+
+static void bench_context_switch(void)
+{
+    static u8 stack[16 * 1024];
+
+    for (s32 preserve_fpu = 1; preserve_fpu >= 0; preserve_fpu--) {
+        g_switch_other = make_fcontext(stack + sizeof(stack), sizeof(stack), switch_loop);
+        jump_fcontext(&g_switch_home, g_switch_other, preserve_fpu, preserve_fpu);
+
+        /* a round trip is two switches */
+        BENCH_RUN(preserve_fpu ? "context_switch_fpu" : "context_switch", 2 * SWITCH_COUNT,
+            for (u32 i = 0; i < SWITCH_COUNT; i++)
+                jump_fcontext(&g_switch_home, g_switch_other, preserve_fpu, preserve_fpu));
+    }
+}
+
+static void start_loop(sptr unused)
+{
+    (void)unused;
+    for (;;) jump_fcontext(&g_switch_other, g_switch_home, 0, 1);
+}
+
+/** Starting new work on a fiber, as the job system does it, a context is made and switched into. 
+ *  The switch back is the same for both, so the difference is what `jump_fcontext_fresh` saves. */
+static void bench_fiber_start(void)
+{
+    static u8 stack[16 * 1024];
+
+    BENCH_RUN("fiber_start_fpu", SWITCH_COUNT,
+        for (u32 i = 0; i < SWITCH_COUNT; i++) {
+            g_switch_other = make_fcontext(stack + sizeof(stack), sizeof(stack), start_loop);
+            jump_fcontext(&g_switch_home, g_switch_other, 0, 1);
+        });
+    BENCH_RUN("fiber_start", SWITCH_COUNT,
+        for (u32 i = 0; i < SWITCH_COUNT; i++) {
+            g_switch_other = make_fcontext(stack + sizeof(stack), sizeof(stack), start_loop);
+            jump_fcontext_fresh(&g_switch_home, g_switch_other, 0);
+        });
+}
+
+/** Many fibers wait at the same time, every one on a chain that many jobs decrement at once. */
+#define WAITER_COUNT        64
+#define WAITER_WORK_COUNT   256
+static FN_LAKE_WORK(waiter_work, void *unused)
+{
+    (void)unused;
+    lake_work_details work[WAITER_WORK_COUNT];
+    for (u32 i = 0; i < WAITER_WORK_COUNT; i++)
+        work[i] = (lake_work_details){ .procedure = empty_work, .name = "bench::empty" };
+    lake_submit_work_and_yield(WAITER_WORK_COUNT, work);
+}
+
+static void bench_chain_waiters(void)
+{
+    lake_work_details work[WAITER_COUNT];
+    for (u32 i = 0; i < WAITER_COUNT; i++)
+        work[i] = (lake_work_details){ .procedure = waiter_work, .name = "bench::waiter" };
+
+    BENCH_RUN("chain_waiters", WAITER_COUNT * WAITER_WORK_COUNT,
+        lake_submit_work_and_yield(WAITER_COUNT, work));
+}
+
+/** A tree of fan-out and fan-in, every inner node submits its children and waits for them. */
+#define TREE_FANOUT 16
+#define TREE_DEPTH  3
+static FN_LAKE_WORK(tree_work, sptr depth)
+{
+    if (depth == 0) return;
+
+    lake_work_details work[TREE_FANOUT];
+    for (u32 i = 0; i < TREE_FANOUT; i++)
+        work[i] = (lake_work_details){ .procedure = (PFN_lake_work)tree_work, .argument = (void *)(depth - 1), .name = "bench::tree" };
+    lake_submit_work_and_yield(TREE_FANOUT, work);
+}
+
+static void bench_fan_tree(void)
+{
+    u64 leaves = 1;
+    for (u32 i = 0; i < TREE_DEPTH; i++) leaves *= TREE_FANOUT;
+
+    BENCH_RUN("fan_tree", leaves, tree_work(TREE_DEPTH));
+}
+
+/** A recursive workload where every job yields, the recursion is unbalanced as in fibonacci. */
+#define YIELD_DEPTH 14
+static FN_LAKE_WORK(yield_work, sptr n)
+{
+    if (n < 2) return;
+
+    lake_work_details work[2] = {
+        { .procedure = (PFN_lake_work)yield_work, .argument = (void *)(n - 1), .name = "bench::yield" },
+        { .procedure = (PFN_lake_work)yield_work, .argument = (void *)(n - 2), .name = "bench::yield" },
+    };
+    lake_submit_work_and_yield(2, work);
+}
+
+static void bench_yield_recursive(void)
+{
+    /* every call is a job, fib(n+1) leaves and one less inner node */
+    u64 a = 0, b = 1;
+    for (u32 i = 0; i <= YIELD_DEPTH; i++) { u64 const c = a + b; a = b; b = c; }
+    u64 const jobs = 2 * a - 1;
+
+    BENCH_RUN("yield_recursive", jobs, yield_work(YIELD_DEPTH));
+}
+
+/** Per-frame scratch allocations from every worker at once, the tag is freed after every round. */
+#define SCRATCH_TAG         0xbe5c
+#define SCRATCH_JOB_COUNT   64
+#define SCRATCH_ALLOC_COUNT 1024
+static FN_LAKE_WORK(scratch_work, void *unused)
+{
+    (void)unused;
+    for (u32 i = 0; i < SCRATCH_ALLOC_COUNT; i++) {
+        u8 *memory = (u8 *)lake_thalloc(SCRATCH_TAG, 64 + (i & 7) * 32, 16);
+        memory[0] = (u8)i;
+    }
+}
+
+static void bench_thalloc_scratch(void)
+{
+    lake_work_details work[SCRATCH_JOB_COUNT];
+    for (u32 i = 0; i < SCRATCH_JOB_COUNT; i++)
+        work[i] = (lake_work_details){ .procedure = scratch_work, .name = "bench::scratch" };
+
+    BENCH_RUN("thalloc_scratch", SCRATCH_JOB_COUNT * SCRATCH_ALLOC_COUNT,
+        lake_submit_work_and_yield(SCRATCH_JOB_COUNT, work);
+        lake_thfree(SCRATCH_TAG));
+}
+
+static void LAKECALL benchmark(void *userdata, lake_bedrock const *bedrock)
+{
+    (void)userdata;
+    g_worker_count = bedrock->hints.worker_thread_count;
+
+    bench_submit_empty();
+    bench_context_switch();
+    bench_fiber_start();
+    bench_chain_waiters();
+    bench_fan_tree();
+    bench_yield_recursive();
+    bench_thalloc_scratch();
+}
+
+s32 LAKECALL lake_main(lake_bedrock *bedrock)
+{
+    lake_bedrock const template = *bedrock;
+    u32 max_workers = bedrock->argc > 1 ? (u32)strtoul(bedrock->argv[1], nullptr, 10) : 0;
+
+    lake_log_enable_colors(false);
+    lake_log_set_level(-2);
+
+    for (u32 workers = 1;; workers <<= 1) {
+        if (max_workers && workers > max_workers) workers = max_workers;
+
+        *bedrock = template;
+        bedrock->engine_name = "Lake Job System Benchmark";
+        bedrock->hints.memory_budget = 512lu*1024lu*1024lu;
+        bedrock->hints.worker_thread_count = workers;
+        /* recursive workloads keep many fibers waiting at once */
+        bedrock->hints.fiber_count = 1024;
+        s32 const status = lake_in_the_lungs(benchmark, nullptr, bedrock);
+        if (status != LAKE_SUCCESS) return status;
+
+        /* the host is known after the first run, the bedrock won't go past its CPU count */
+        u32 const cpu_count = (u32)bedrock->host.cpu_thread_count;
+        if (max_workers == 0 || max_workers > cpu_count) max_workers = cpu_count;
+        if (workers >= max_workers) break;
+    }
+    return LAKE_SUCCESS;
+}
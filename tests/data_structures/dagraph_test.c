@@ -1,7 +1,66 @@
 #include "../test_framework.h"
 
+struct diamond {
+    atomic_u32  step;
+    u32         order[4];
+};
+
+struct diamond_node {
+    struct diamond *diamond;
+    u32             idx;
+};
+
+static FN_LAKE_WORK(diamond_work, struct diamond_node *node)
+{
+    u32 const step = lake_atomic_add_explicit(&node->diamond->step, 1u, lake_memory_model_acq_rel);
+    node->diamond->order[node->idx] = step;
+}
+
+FN_TEST_CASE(DS_dagraph, run_diamond_twice, void *)
+{
+    /* 0 -> (1, 2) -> 3 */
+    lake_dagraph_id deps_1[] = { 0 };
+    lake_dagraph_id deps_2[] = { 0 };
+    lake_dagraph_id deps_3[] = { 1, 2 };
+    lake_dagraph_id dependents_0[] = { 1, 2 };
+    lake_dagraph_id dependents_1[] = { 3 };
+    lake_dagraph_id dependents_2[] = { 3 };
+
+    struct diamond diamond;
+    struct diamond_node payloads[4];
+    lake_dagraph_node nodes[4] = {
+        { .id = 0, .dependents = dependents_0, .dependents_count = 2 },
+        { .id = 1, .dependencies = deps_1, .dependencies_count = 1, .dependents = dependents_1, .dependents_count = 1 },
+        { .id = 2, .dependencies = deps_2, .dependencies_count = 1, .dependents = dependents_2, .dependents_count = 1 },
+        { .id = 3, .dependencies = deps_3, .dependencies_count = 2 },
+    };
+    for (u32 i = 0; i < lake_arraysize(nodes); i++) {
+        payloads[i] = (struct diamond_node){ .diamond = &diamond, .idx = i };
+        nodes[i].work = (PFN_lake_work)diamond_work;
+        nodes[i].payload = &payloads[i];
+    }
+    lake_dagraph graph = { .nodes = { .v = nodes, .len = lake_arraysize(nodes), .cap = lake_arraysize(nodes) } };
+
+    /* a graph must be reusable without being rebuilt */
+    for (u32 run = 0; run < 2; run++) {
+        lake_atomic_init(&diamond.step, 0u);
+        lake_dagraph_run(&graph);
+
+        if (diamond.order[0] != 0 || diamond.order[3] != 3 || 
+            diamond.order[1] == 0 || diamond.order[1] == 3 ||
+            diamond.order[2] == 0 || diamond.order[2] == 3) 
+        {
+            test_log_context();
+            test_log("run %u executed out of order: %u %u %u %u", run, 
+                diamond.order[0], diamond.order[1], diamond.order[2], diamond.order[3]);
+            return TEST_RESULT_FAILED;
+        }
+    }
+    return TEST_RESULT_OKAY;
+}
+
 static struct test_case_details g_tests[] = {
-    //IMPL_TEST_CASE(DS_dagraph, todo),
+    IMPL_TEST_CASE(DS_dagraph, run_diamond_twice),
 };
 
 FN_TEST_SUITE_INIT(DS_dagraph)
@@ -1,7 +1,54 @@
 #include "../test_framework.h"
 
+FN_TEST_CASE(DS_mpmc, bulk_wraps_around, void *)
+{
+    lake_mpmc mpmc;
+    lake_mpmc_node nodes[16];
+    lake_mpmc_init_t(&mpmc, lake_mpmc_node, lake_arraysize(nodes), nodes);
+
+    ssize in[24], out[24];
+    for (u32 i = 0; i < lake_arraysize(in); i++) in[i] = i;
+
+    /* move the positions off zero, so the bulk range wraps around the buffer */
+    for (s32 i = 0; i < 10; i++) {
+        ssize value;
+        lake_mpmc_enqueue_t(&mpmc, lake_mpmc_node, &in[i]);
+        lake_mpmc_dequeue_t(&mpmc, lake_mpmc_node, &value);
+    }
+    s32 const pushed = lake_mpmc_enqueue_bulk_t(&mpmc, lake_mpmc_node, in, lake_arraysize(in));
+    if (pushed != (s32)lake_arraysize(nodes)) {
+        test_log_context();
+        test_log("expected to enqueue %d values into a full ring, got %d", (s32)lake_arraysize(nodes), pushed);
+        return TEST_RESULT_FAILED;
+    }
+    if (lake_mpmc_enqueue_t(&mpmc, lake_mpmc_node, &in[0])) {
+        test_log_context();
+        test_log("enqueued into a full ring");
+        return TEST_RESULT_FAILED;
+    }
+    s32 const popped = lake_mpmc_dequeue_bulk_t(&mpmc, lake_mpmc_node, out, lake_arraysize(out));
+    if (popped != pushed) {
+        test_log_context();
+        test_log("expected to dequeue %d values, got %d", pushed, popped);
+        return TEST_RESULT_FAILED;
+    }
+    for (s32 i = 0; i < popped; i++) {
+        if (out[i] != in[i]) {
+            test_log_context();
+            test_log("out of order at %d: %ld != %ld", i, out[i], in[i]);
+            return TEST_RESULT_FAILED;
+        }
+    }
+    if (lake_mpmc_dequeue_bulk_t(&mpmc, lake_mpmc_node, out, 4) != 0) {
+        test_log_context();
+        test_log("dequeued from an empty ring");
+        return TEST_RESULT_FAILED;
+    }
+    return TEST_RESULT_OKAY;
+}
+
 static struct test_case_details g_tests[] = {
-    //IMPL_TEST_CASE(DS_mpmc, todo),
+    IMPL_TEST_CASE(DS_mpmc, bulk_wraps_around),
 };
 
 FN_TEST_SUITE_INIT(DS_mpmc)
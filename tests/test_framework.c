@@ -116,9 +116,11 @@ static s32 LAKECALL run_test_suite(
         runs[i].status_ok   = &suite->status_ok;
         runs[i].status_skip = &suite->status_skip;
         runs[i].status_fail = &suite->status_fail;
-        work[i].procedure   = (PFN_lake_work)run_test;
-        work[i].argument    = &runs[i];
-        work[i].name        = construct_fiber_name(suite->name, runs[i].details.name);
+        work[i] = (lake_work_details){
+            .procedure = (PFN_lake_work)run_test,
+            .argument = &runs[i],
+            .name = construct_fiber_name(suite->name, runs[i].details.name),
+        };
     }
     lake_submit_work_and_yield(test_count, work);
     u64 const time_end = lake_rtc_counter();
@@ -222,6 +224,8 @@ s32 LAKECALL lake_main(lake_bedrock *bedrock)
     bedrock->hints.networking_offline = false;
     bedrock->hints.fiber_stack_size = 128*1024;
     bedrock->hints.log2_work_count = 11;
+    /* free blocks are trimmed in the background while the tests run */
+    bedrock->hints.tagged_heap_high_water_mark = 16lu*1024lu*1024lu;
     if (bedrock->argc > 1) 
         g_run_target = bedrock->argv[1];
     lake_log_enable_colors(true);
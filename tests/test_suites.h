@@ -12,6 +12,7 @@ DECL_TEST_SUITE(Bedrock_magic)
 DECL_TEST_SUITE(Bedrock_network)
 DECL_TEST_SUITE(Bedrock_simd)
 DECL_TEST_SUITE(Bedrock_tagged_heap)
+DECL_TEST_SUITE(Bedrock_tagged_heap_trim)
 DECL_TEST_SUITE(Bedrock_truetype)
 
 /* data structures */